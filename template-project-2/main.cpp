@@ -3,6 +3,7 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<new>
 
 extern "C" {
 #include"./SDL2-2.0.10/include/SDL.h"
@@ -10,6 +11,21 @@ extern "C" {
 #include <time.h>
 }
 
+// used for memory mapping the highscores and the sprite atlas
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOUSER // LoadBitmap would clash with the function in this file
+#define NOGDI
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 #define FULLSCREEN false
 #define WINDOW_TITLE "Filip Jezierski 196333"
@@ -17,18 +33,85 @@ extern "C" {
 #define SCREEN_HEIGHT 480
 
 #define FPS_LIMIT 144 // set to -1 for unlimited FPS
+#define SIM_TICK_RATE 120 // game logic updates per second
+#define SIM_TICK_DELTA (1.0 / SIM_TICK_RATE)
+#define SIM_MAX_FRAME_DELTA 0.25 // longer frames are cut short so the simulation can catch up
 #define FPS_COUNTER_INTERVAL 0.1
-#define RAND_VAL_PRECISION 100
 
 #define STRING_BUFFER_SIZE 128
-
-
-#define HIGHSCORES_FILE "highscores.txt"
+#define TEXT_CACHE_SIZE 64 // rendered texts kept for the next frames
+#define DIRTY_RECT_LIMIT 8 // when more parts of the screen change, they're merged into one
+
+// every game allocates its objects from an arena of this size
+#define GAME_ARENA_SIZE (16 << 20)
+#define ARENA_ALIGNMENT 16
+
+// frame profiler (shown in the F3 debug overlay)
+#define PROFILER_HISTORY 200 // frames kept for the graph and the statistics
+#define PROFILER_GRAPH_HEIGHT 80
+#define PROFILER_GRAPH_MS 20.0 // frame time at the top of the graph
+#define BLIT_REPORT_REPEATS 200 // timed blits of every sprite with --blit-report
+
+// headless simulation (started with --headless [ticks])
+#define HEADLESS_DEFAULT_TICKS 1000000
+
+// input replays (--record <prefix>, --replay <file>)
+#define REPLAY_MAGIC "SHRP"
+#define REPLAY_VERSION 1
+#define REPLAY_MAX_RUN_LENGTH 0xFFFF
+
+// all sprites are packed into one memory mapped archive (--pack-atlas <archive> [files...]):
+// "SHAT" | version u32 | width u32 | height u32 | sprite count u32 | pixel offset u32
+// followed by sprite count * (name char[24] | x u32 | y u32 | w u32 | h u32 | flags u32)
+// and width * height ARGB8888 pixels starting at the pixel offset
+// when the archive doesn't exist the sprites are loaded from ./sprites/<name>.bmp
+#define SPRITE_ATLAS_FILE "sprites.atlas"
+#define SPRITE_ATLAS_MAGIC "SHAT"
+#define SPRITE_ATLAS_VERSION 1
+#define SPRITE_ATLAS_HEADER_SIZE 24
+#define SPRITE_ATLAS_ENTRY_SIZE 44
+#define SPRITE_ATLAS_NAME_LENGTH 24
+#define SPRITE_ATLAS_WIDTH 1280 // fits the background and the grass side by side
+#define SPRITE_ATLAS_PIXEL_ALIGNMENT 16
+#define SPRITE_ATLAS_FILES { \
+	"./sprites/background.bmp", "./sprites/bullet.bmp", "./sprites/civilian_car.bmp", "./sprites/cs8x8.bmp", \
+	"./sprites/enemy_car.bmp", "./sprites/explosion_0.bmp", "./sprites/explosion_1.bmp", "./sprites/gun.bmp", \
+	"./sprites/player_car.bmp", "./sprites/road_edge.bmp", \
+	"./unusedsprites/enemy_bike.bmp", "./unusedsprites/enemy_chopper.bmp", \
+	"./unusedsprites/enemy_chopper_blades_0.bmp", "./unusedsprites/enemy_chopper_blades_1.bmp", \
+	"./unusedsprites/enemy_chopper_blades_2.bmp", "./unusedsprites/enemy_chopper_blades_3.bmp", \
+	"./unusedsprites/grass.bmp", "./unusedsprites/road.bmp", "./unusedsprites/road_slope_l.bmp", \
+	"./unusedsprites/tree0.bmp", "./unusedsprites/tree1.bmp", "./unusedsprites/truck.bmp" }
+
+
+// highscores are stored in a binary file:
+// "SHHS" | version u32 | record count u32 | checksum u32
+// followed by record count * (score i32 | time i32)
+// the text files of older versions are imported when the binary file doesn't exist yet
+#define HIGHSCORES_FILE "highscores.bin"
+#define HIGHSCORES_TEXT_FILES { "highscores.txt", "highscores1.txt" }
+#define HIGHSCORES_MAGIC "SHHS"
+#define HIGHSCORES_VERSION 1
+#define HIGHSCORES_HEADER_SIZE 16
+#define HIGHSCORES_RECORD_SIZE 8
+#define HIGHSCORES_CHECKSUM_SEED 2166136261u
+// saved scores are written by a background thread to an append-only journal:
+// record number u32 | score i32 | time i32 | checksum u32
+// the journal is added to the binary file when the leaderboard is loaded
+#define HIGHSCORES_JOURNAL_FILE "highscores.journal"
+#define HIGHSCORES_JOURNAL_RECORD_SIZE 16
+#define SCORE_QUEUE_SIZE 64 // scores waiting for the writer thread
+#define SCORE_WRITER_RETRY_DELAY 5.0 // seconds between attempts to start the score writer
 #define LEADERBOARD_LENGTH 20
 #define LEADERBOARD_SCROLL_DELAY 0.02
-
-
-#define ROAD_EDGE_SEGMENTS 7
+#define LEADERBOARD_WINDOW 100 // rows of every sort order kept in memory, at least 2 * LEADERBOARD_LENGTH
+// the rank of the current score is counted in buckets of scores,
+// with the size being a divisor of all points the player can get the ranks are exact
+#define SCORE_RANK_BUCKET_SIZE 50
+#define SCORE_RANK_BUCKETS 65536 // higher scores all share the last bucket
+// highscore files are merged with an external sort (--merge)
+#define MERGE_CHUNK_RECORDS (1 << 20) // highscores sorted in memory at once
+#define MERGE_RUN_BUFFER 512 // highscores read ahead from every sorted chunk
 
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -68,7 +151,7 @@ extern "C" {
 
 #define PLAYER_GUN_RANGE 150
 #define PLAYER_FIRE_INTERVAL 0.08
-#define MAX_BULLETS 16
+#define BULLET_INITIAL_CAPACITY 64 // the bullet arrays grow when more bullets are in flight
 #define BULLET_SIZE { 4, 10 }
 #define BULLET_SPEED 500
 #define RIFLE_BULLETS_PER_PICKUP 50
@@ -90,14 +173,16 @@ extern "C" {
 #define CIVILIAN_SPEED_SIDES 500
 #define CIVILIAN_ACCEL 400
 #define CIVILIAN_ACCEL_SIDES 1000
+#define CIVILIAN_SWERVE_CHANCE 0.2 // swerves per second
+#define CIVILIAN_SWERVE_SPEED 200
 
 
 #define NPC_EDGE_DISTANCE 40
 
 // NPC & powerup spawning
 
-// this is a hard limit that cannot be exceeded
-#define MAX_NPCS 16
+// NPC storage starts with this capacity and grows when more cars are spawned
+#define NPC_INITIAL_CAPACITY 16
 #define OBJECT_SPAWN_TICK_INTERVAL 0.5
 #define OBJECT_SPAWN_MARGIN 20 // objects are spawned this far above the screen edge
 #define POWERUP_SPAWN_CHANCE 0.1
@@ -109,13 +194,19 @@ extern "C" {
 //////////////////////////////////////////////////////////////////////////////////////
 // ROAD GENERATION CONSTANTS
 
-#define ROAD_EDGE_WIDTH 600
 #define ROAD_BEND_FREQUENCY 0.0001
+#define OPAQUE_FILL_DISTANCE 32 // transparent holes in the grass texture are filled from this far away
 #define ROAD_CENTER_VARIATION 100
 #define ROAD_WIDTH_FREQUENCY 0.0003
 #define ROAD_MIN_WIDTH 100
 #define ROAD_MAX_WIDTH 300
 
+// the road shape is cached in a ring buffer, sampled every ROAD_PROFILE_STEP units of distance
+// the cache is centered on the player and covers ROAD_PROFILE_SAMPLES * ROAD_PROFILE_STEP units
+// (everything between OBJECT_DELETE_DISTANCE behind and ahead of the screen has to fit)
+#define ROAD_PROFILE_STEP 4
+#define ROAD_PROFILE_SAMPLES 512
+
 
 
 
@@ -123,6 +214,7 @@ enum NPCType
 {
 	ENEMY,
 	CIVILIAN,
+	NPC_TYPE_COUNT
 };
 
 enum UIAnchor
@@ -151,8 +243,15 @@ struct Time
 {
 	long timeCounterCurrent, timeCounterPrevious;
 	double time;
+	double frameDelta; // real time between frames
+
+	// the game logic runs in fixed steps of SIM_TICK_DELTA
+	// gametime is always derived from the tick counter, so it doesn't drift
+	long long ticks;
 	double gametime;
 	double delta;
+	double accumulator; // real time that hasn't been simulated yet
+	double alpha; // how far the rendered frame is between the last two ticks (0-1)
 	bool paused;
 
 	// these variables are used for calculating the FPS
@@ -176,6 +275,7 @@ struct Input
 	bool shoot;
 
 	bool showDebug;
+	bool redraw; // the window has to be drawn again, e.g. after it was uncovered
 };
 
 
@@ -215,1170 +315,4568 @@ int Sign(double num)
 	return 0;
 }
 
-// returns a random value in the range 0-1
-double RandVal()
+// linear interpolation between a and b, t is in the range 0-1
+Vector2 Lerp(Vector2 a, Vector2 b, double t)
 {
-	return (double)(rand() % RAND_VAL_PRECISION) / RAND_VAL_PRECISION;
+	return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
 }
 
-// returns a random value in the range r1-r2
-double RandRange(double r1, double r2)
+// the text helpers below replace sprintf in the HUD, which is drawn every frame
+
+// copies text to buffer, returns its length
+int CopyText(char* buffer, const char* text)
 {
-	return r1 + (r2 - r1) * RandVal();
+	int length = (int)strlen(text);
+	memcpy(buffer, text, length + 1);
+	return length;
 }
 
-
-//////////////////////////////////////////////////////////////////////////////////////
-// RENDERING
-
-// draw a text on surface screen, offset by (x, y) from the anchor
-// charset is a 128x128 bitmap containing character images
-void DrawString(SDL_Surface* screen, Vector2 offset, const char* text, SDL_Surface* charset, UIAnchor anchor)
+// two digits at a time, used by FormatInteger
+const char DIGIT_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// writes value in decimal to buffer, right aligned in at least width characters
+// returns the number of characters written, not counting the terminating 0
+int FormatInteger(char* buffer, Sint64 value, int width)
 {
-	int x = offset.x;
-	int y = offset.y;
-	Vector2 size = { strlen(text) * 8, 8 };
-
-	switch (anchor)
+	// the digits are produced from the last one
+	char digits[24];
+	int count = 0;
+	Uint64 magnitude = value < 0 ? 0 - (Uint64)value : (Uint64)value;
+	while (magnitude >= 10)
 	{
-	case CENTER:
-		x += screen->w / 2 - size.x / 2;
-		y += screen->h / 2 - size.y / 2;
-		break;
-	case UPPER_LEFT:
-		break;
-	case UPPER_RIGHT:
-		x += screen->w - size.x;
-		break;
-	case LOWER_LEFT:
-		y += screen->h - size.y;
-		break;
-	case LOWER_RIGHT:
-		x += screen->w - size.x;
-		y += screen->h - size.y;
-		break;
-	case MIDDLE_LEFT:
-		y += screen->h / 2 - size.y / 2;
-		break;
-	case MIDDLE_RIGHT:
-		x += screen->w - size.x;
-		y += screen->h / 2 - size.y / 2;
-		break;
-	case UPPER_CENTER:
-		x += screen->w / 2 - size.x / 2;
-		break;
-	case LOWER_CENTER:
-		x += screen->w / 2 - size.x / 2;
-		y += screen->h - size.y;
-		break;
-	default:
-		break;
+		int pair = (int)(magnitude % 100) * 2;
+		magnitude /= 100;
+		digits[count++] = DIGIT_PAIRS[pair + 1];
+		digits[count++] = DIGIT_PAIRS[pair];
 	}
+	if (magnitude > 0 || count == 0)
+		digits[count++] = (char)('0' + magnitude);
+	if (value < 0)
+		digits[count++] = '-';
+
+	int length = 0;
+	while (length < width - count)
+		buffer[length++] = ' ';
+	while (count > 0)
+		buffer[length++] = digits[--count];
+	buffer[length] = 0;
+	return length;
+}
 
-	int px, py, c;
-	SDL_Rect s, d;
-	s.w = 8;
-	s.h = 8;
-	d.w = 8;
-	d.h = 8;
-	while (*text)
+// writes value rounded to the given number of decimals, right aligned in at least width characters
+// returns the number of characters written, not counting the terminating 0
+int FormatFixed(char* buffer, double value, int decimals, int width)
+{
+	Sint64 scale = 1;
+	for (int i = 0; i < decimals; i++)
+		scale *= 10;
+	Sint64 scaled = (Sint64)floor(fabs(value) * scale + 0.5);
+
+	char text[48];
+	int length = 0;
+	if (value < 0 && scaled != 0)
+		text[length++] = '-';
+	length += FormatInteger(text + length, scaled / scale, 0);
+	if (decimals > 0)
 	{
-		c = *text;
-		px = (c % 16) * 8;
-		py = (c / 16) * 8;
-		s.x = px;
-		s.y = py;
-		d.x = x;
-		d.y = y;
-		SDL_BlitSurface(charset, &s, screen, &d);
-		x += 8;
-		text++;
+		Sint64 fraction = scaled % scale;
+		text[length++] = '.';
+		for (int i = decimals - 1; i >= 0; i--)
+		{
+			text[length + i] = (char)('0' + fraction % 10);
+			fraction /= 10;
+		}
+		length += decimals;
 	}
+	text[length] = 0;
+
+	int padding = __max(width - length, 0);
+	memset(buffer, ' ', padding);
+	memcpy(buffer + padding, text, length + 1);
+	return padding + length;
 }
 
-// draw a surface sprite on a surface screen in point (x, y)
-// (x, y) is the center of sprite on screen
-void DrawSurface(SDL_Surface* screen, SDL_Surface* sprite, int x, int y)
+// writes a label followed by a number, e.g. "Lives: 3"
+// returns buffer
+char* FormatLabel(char* buffer, const char* label, Sint64 value)
 {
-	SDL_Rect dest;
-	dest.x = x - sprite->w / 2;
-	dest.y = y - sprite->h / 2;
-	dest.w = sprite->w;
-	dest.h = sprite->h;
-	SDL_BlitSurface(sprite, NULL, screen, &dest);
+	int length = CopyText(buffer, label);
+	FormatInteger(buffer + length, value, 0);
+	return buffer;
 }
 
-// draw a single pixel
-void DrawPixel(SDL_Surface* surface, int x, int y, Uint32 color)
+// state of a xoshiro256** pseudo random number generator
+// every game owns its generators, so games with the same seed play out the same way
+struct Random
 {
-	int bpp = surface->format->BytesPerPixel;
-	Uint8* p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
-	*(Uint32*)p = color;
+	Uint64 state[4];
+};
+
+// separate streams, so that e.g. adding an AI decision doesn't change where objects spawn
+// every stream is seeded with its index
+enum RandomStream
+{
+	RNG_SPAWNING,
+	RNG_AI,
+	RNG_POWERUPS,
+	RNG_STRESS, // the extra cars of a headless stress run (--npcs)
+	RNG_STREAM_COUNT
+};
+
+// splitmix64, used to expand a single seed into generator states
+Uint64 SplitMix64(Uint64* x)
+{
+	Uint64 z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
 }
 
-// draw a vertical (when dx = 0, dy = 1) or horizontal (when dx = 1, dy = 0) line
-void DrawLine(SDL_Surface* screen, int x, int y, int l, int dx, int dy, Uint32 color)
+void SeedRandom(Random* random, Uint64 seed, int stream)
 {
-	for (int i = 0; i < l; i++)
-	{
-		DrawPixel(screen, x, y, color);
-		x += dx;
-		y += dy;
-	}
+	Uint64 x = seed ^ ((Uint64)stream * 0xD1B54A32D192ED03ULL);
+	for (int i = 0; i < 4; i++)
+		random->state[i] = SplitMix64(&x);
 }
 
-// draw a rectangle of size l by k
-void DrawRectangle(SDL_Surface* screen, int x, int y, int l, int k, Uint32 outlineColor, Uint32 fillColor)
+Uint64 RotateLeft(Uint64 x, int k)
 {
-	int i;
-	DrawLine(screen, x, y, k, 0, 1, outlineColor);
-	DrawLine(screen, x + l - 1, y, k, 0, 1, outlineColor);
-	DrawLine(screen, x, y, l, 1, 0, outlineColor);
-	DrawLine(screen, x, y + k - 1, l, 1, 0, outlineColor);
-	for (i = y + 1; i < y + k - 1; i++)
-		DrawLine(screen, x + 1, i, l - 2, 1, 0, fillColor);
+	return (x << k) | (x >> (64 - k));
 }
 
+Uint64 NextRandom(Random* random)
+{
+	Uint64* s = random->state;
+	Uint64 result = RotateLeft(s[1] * 5, 7) * 9;
+	Uint64 t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = RotateLeft(s[3], 45);
+
+	return result;
+}
 
+// returns a random value in the range 0-1 (1 excluded)
+double RandVal(Random* random)
+{
+	// the top 53 bits fill the whole mantissa of a double
+	return (NextRandom(random) >> 11) * (1.0 / 9007199254740992.0);
+}
 
+// returns a random value in the range r1-r2
+double RandRange(Random* random, double r1, double r2)
+{
+	return r1 + (r2 - r1) * RandVal(random);
+}
 
 
-//////////////////////////////////////////////////////////////////////////////////////
-// LOADING IMAGES
+// debug builds count every allocation made with new or with the Counted* functions,
+// which the rest of the file uses instead of malloc, calloc and realloc
+// the simulation checks that a tick doesn't allocate anything outside of the arena
+#if SDL_ASSERT_LEVEL >= 2
+SDL_atomic_t allocationCount;
 
-bool InitialiseSDL(SDL_Window** window, SDL_Renderer** renderer, SDL_Surface** screen, SDL_Texture** scrtex)
+void CountAllocation()
 {
-	if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
-	{
-		printf("SDL_Init error: %s\n", SDL_GetError());
-		return false;
-	}
+	SDL_AtomicAdd(&allocationCount, 1);
+}
 
-	int error = -1;
+void* operator new(size_t size)
+{
+	CountAllocation();
+	void* memory = malloc(size > 0 ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
 
-	if (FULLSCREEN)
-		error = SDL_CreateWindowAndRenderer(0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP, window, renderer);
-	else
-		error = SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, window, renderer);
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
 
-	if (error != 0)
-	{
-		SDL_Quit();
-		printf("SDL_CreateWindowAndRenderer error: %s\n", SDL_GetError());
-		return false;
-	}
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
 
-	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
-	SDL_RenderSetLogicalSize(*renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
-	SDL_SetRenderDrawColor(*renderer, 0, 0, 0, 255);
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
 
-	SDL_SetWindowTitle(*window, WINDOW_TITLE);
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
 
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
 
-	*screen = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
-		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+int GetAllocationCount()
+{
+	return SDL_AtomicGet(&allocationCount);
+}
+#else
+void CountAllocation()
+{
+}
 
-	*scrtex = SDL_CreateTexture(*renderer, SDL_PIXELFORMAT_ARGB8888,
-		SDL_TEXTUREACCESS_STREAMING,
-		SCREEN_WIDTH, SCREEN_HEIGHT);
+int GetAllocationCount()
+{
+	return 0;
+}
+#endif
 
+void* CountedMalloc(size_t size)
+{
+	CountAllocation();
+	return malloc(size);
+}
 
-	SDL_ShowCursor(SDL_DISABLE);
+void* CountedCalloc(size_t count, size_t size)
+{
+	CountAllocation();
+	return calloc(count, size);
+}
 
-	return true;
+void* CountedRealloc(void* memory, size_t size)
+{
+	CountAllocation();
+	return realloc(memory, size);
 }
 
-// load a single sprite
-// returns true when successful
-bool LoadBitmap(SDL_Surface** surface, const char* filename)
+
+// all memory of a single game comes from one block and is released at once when the game ends
+struct Arena
 {
-	*surface = SDL_LoadBMP(filename);
-	if (*surface == NULL)
+	Uint8* memory = NULL;
+	size_t size = 0;
+	size_t used = 0;
+};
+
+bool CreateArena(Arena* arena, size_t size)
+{
+	*arena = Arena();
+	arena->memory = (Uint8*)CountedMalloc(size);
+	if (arena->memory == NULL)
 	{
-		printf("SDL_LoadBMP(%s) error: %s\n", filename, SDL_GetError());
+		printf("Ran out of memory when creating an arena of %zu bytes!\n", size);
 		return false;
 	}
-	printf("SDL_LoadBMP(%s) bitmap loaded successfully\n", filename);
+	arena->size = size;
 	return true;
 }
 
-// indexes of all bitmaps
-// last element in the enum is used to get the number of other elements
-enum BitmapData
+// returns NULL when the arena is full
+void* ArenaAlloc(Arena* arena, size_t size)
 {
-	BMP_CHARSET,
-	BMP_PLAYER_CAR,
-	BMP_ENEMY_CAR,
-	BMP_CIVILIAN_CAR,
-	BMP_EXPLOSION_0,
-	BMP_EXPLOSION_1,
-	BMP_BULLET,
-	BMP_RIFLE,
-	BMP_BACKGROUND,
-	BMP_ROAD_EDGE,
-	BMP_COUNT
-};
-
-// load all sprites
-// returns true when successful
-bool LoadAllBitmaps(SDL_Surface** bmps)
-{
-	bool error = false;
-
-	error |= !LoadBitmap(&bmps[BMP_CHARSET], "./sprites/cs8x8.bmp");
-	error |= !LoadBitmap(&bmps[BMP_PLAYER_CAR], "./sprites/player_car.bmp");
-	error |= !LoadBitmap(&bmps[BMP_ENEMY_CAR], "./sprites/enemy_car.bmp");
-	error |= !LoadBitmap(&bmps[BMP_CIVILIAN_CAR], "./sprites/civilian_car.bmp");
-	error |= !LoadBitmap(&bmps[BMP_EXPLOSION_0], "./sprites/explosion_0.bmp");
-	error |= !LoadBitmap(&bmps[BMP_EXPLOSION_1], "./sprites/explosion_1.bmp");
-	error |= !LoadBitmap(&bmps[BMP_BULLET], "./sprites/bullet.bmp");
-	error |= !LoadBitmap(&bmps[BMP_RIFLE], "./sprites/gun.bmp");
-	error |= !LoadBitmap(&bmps[BMP_BACKGROUND], "./sprites/background.bmp");
-	error |= !LoadBitmap(&bmps[BMP_ROAD_EDGE], "./sprites/road_edge.bmp");
-
-	if (error)
-		return false;
+	size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if (start + size > arena->size)
+	{
+		printf("Ran out of arena memory when allocating %zu bytes!\n", size);
+		return NULL;
+	}
+	arena->used = start + size;
+	return arena->memory + start;
+}
 
-	SDL_SetColorKey(bmps[BMP_CHARSET], true, 0x000000);
-	return true;
+// arena memory can't be resized, so the used part of an array is copied to a new, bigger one
+// the old array stays in the arena until it's reset, returns NULL when the arena is full
+void* GrowArenaArray(Arena* arena, void* array, size_t usedSize, size_t newSize)
+{
+	void* grown = ArenaAlloc(arena, newSize);
+	if (grown != NULL && usedSize > 0)
+		memcpy(grown, array, usedSize);
+	return grown;
 }
 
+// objects in the arena are never destroyed, so they can't own any other memory
+template <typename T>
+T* ArenaNew(Arena* arena)
+{
+	void* memory = ArenaAlloc(arena, sizeof(T));
+	return memory != NULL ? new (memory) T() : NULL;
+}
 
+void ResetArena(Arena* arena)
+{
+	arena->used = 0;
+}
 
+void FreeArena(Arena* arena)
+{
+	free(arena->memory);
+	*arena = Arena();
+}
 
+void WriteLE(FILE* file, Uint64 value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		fputc((int)((value >> (i * 8)) & 0xFF), file);
+}
+Uint64 ReadLE(FILE* file, int bytes)
+{
+	Uint64 value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (Uint64)(fgetc(file) & 0xFF) << (i * 8);
+	return value;
+}
 
-//////////////////////////////////////////////////////////////////////////////////////
-// GAME OBJECTS
+// a memory mapping of a whole file, read-only unless it was mapped copy-on-write
+struct MappedFile
+{
+	const Uint8* data = NULL;
+	Sint64 size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int file = -1;
+#endif
+};
 
-struct GameData;
+void UnmapFile(MappedFile* mapped)
+{
+#ifdef _WIN32
+	if (mapped->data != NULL) UnmapViewOfFile(mapped->data);
+	if (mapped->mapping != NULL) CloseHandle(mapped->mapping);
+	if (mapped->file != INVALID_HANDLE_VALUE) CloseHandle(mapped->file);
+#else
+	if (mapped->data != NULL) munmap((void*)mapped->data, mapped->size);
+	if (mapped->file >= 0) close(mapped->file);
+#endif
+	*mapped = MappedFile();
+}
 
-class GameObject
+// with copyOnWrite the mapped pages can be changed, the changes stay in memory and never reach the file
+// returns true when successful
+bool MapFile(MappedFile* mapped, const char* filename, bool copyOnWrite)
 {
-public:
-	bool visible = true;
-	Vector2 position = {};
-	Vector2 size = {};
-	SDL_Surface* sprite = NULL;
-	
-	virtual void Draw(SDL_Surface* screen)
+	*mapped = MappedFile();
+#ifdef _WIN32
+	mapped->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size = {};
+	if (mapped->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0)
 	{
-		if (!visible) return;
+		UnmapFile(mapped);
+		return false;
+	}
+	mapped->size = size.QuadPart;
+	mapped->mapping = CreateFileMappingA(mapped->file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	if (mapped->mapping != NULL)
+		mapped->data = (const Uint8*)MapViewOfFile(mapped->mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	if (mapped->data == NULL)
+	{
+		UnmapFile(mapped);
+		return false;
+	}
+#else
+	mapped->file = open(filename, O_RDONLY);
+	struct stat info;
+	if (mapped->file < 0 || fstat(mapped->file, &info) != 0 || info.st_size == 0)
+	{
+		UnmapFile(mapped);
+		return false;
+	}
+	mapped->size = info.st_size;
+	void* data = copyOnWrite ?
+		mmap(NULL, mapped->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, mapped->file, 0) :
+		mmap(NULL, mapped->size, PROT_READ, MAP_SHARED, mapped->file, 0);
+	if (data == MAP_FAILED)
+	{
+		UnmapFile(mapped);
+		return false;
+	}
+	mapped->data = (const Uint8*)data;
+#endif
+	return true;
+}
 
-		if (sprite == NULL)
-		{
-			printf("Error while drawing GameObject: sprite is NULL\n");
-			return;
-		}
 
-		DrawSurface(screen, sprite, position.x, position.y);
-	}
-};
+//////////////////////////////////////////////////////////////////////////////////////
+// PROFILING
 
-class Car : public GameObject
+// parts of a frame that are timed separately
+enum ProfilerStage
 {
-public:
-	Vector2 speed = {};
+	STAGE_UPDATE_PLAYER,
+	STAGE_UPDATE_NPCS,
+	STAGE_UPDATE_BULLETS,
+	STAGE_RESOLVE_COLLISIONS,
+	STAGE_OBJECT_SPAWNING,
+	STAGE_DRAW_GAME_OBJECTS,
+	STAGE_DRAW_UI,
+	STAGE_REDRAW,
+	STAGE_FRAME_COPY,
+	STAGE_PRESENT,
+	STAGE_EVENTS,
+	STAGE_COUNT
+};
 
-	SDL_Surface* explosion0 = NULL;
-	SDL_Surface* explosion1 = NULL;
+const char* PROFILER_STAGE_NAMES[STAGE_COUNT] = {
+	"Player",
+	"NPCs",
+	"Bullets",
+	"Collisions",
+	"Spawning",
+	"Draw objects",
+	"Draw UI",
+	"Redraw",
+	"Frame copy",
+	"Present",
+	"Events",
+};
 
-	double deathTime = 0;
-	bool IsDead()
-	{
-		return deathTime > 0;
-	}
+enum TraceEventType
+{
+	TRACE_STAGE, // a single run of a stage
+	TRACE_FRAME, // a whole frame
+	TRACE_COUNTERS,
+};
 
-	// returns true if the animation has ended & the car can be deleted
-	bool AnimateDeath(Time time)
-	{
-		if (deathTime > 0)
-		{
-			if (time.gametime >= deathTime + DEATH_ANIM_DURATION)
-				return true; 
-			else if (time.gametime >= deathTime + DEATH_ANIM_DURATION / 2)
-				sprite = explosion1;
-			else if (time.gametime >= deathTime)
-				sprite = explosion0;
-		}
-
-		return false;
-	}
-};
-
-class Player : public Car
+// times are performance counter values
+struct TraceEvent
 {
-public:
-	double distanceCounter = 0;
-	double scoringDistanceCounter = 0;
-	double nextShootTime = 0;
-	double scorePenalty = 0;
-	int score = 0;
-	int lifeScoreCounter = 0;
-	int lives = 0;
-	int rifleAmmo = 0;
+	TraceEventType type;
+	ProfilerStage stage;
+	Uint64 start;
+	Uint64 end;
+	int npcCount;
+	int visibleBullets;
 };
 
-class NPC : public Car
+// time spent in every stage (in seconds) during the last PROFILER_HISTORY frames
+// the stages of the game logic are summed over all ticks simulated in a frame
+struct Profiler
 {
-public:
-	NPCType type = ENEMY;
-	int health = 0;
+	double current[STAGE_COUNT] = {};
+	double history[PROFILER_HISTORY][STAGE_COUNT] = {};
+	int historyIndex = 0; // where the next frame is stored
+	int historyCount = 0;
+
+	// bytes copied from the screen surface to the streaming texture, none with a locked frame
+	int currentCopiedBytes = 0;
+	int copiedBytes[PROFILER_HISTORY] = {};
+
+	// when tracing, every measurement is also kept in memory until the trace is written
+	bool tracing = false;
+	Uint64 traceStart = 0;
+	Uint64 frameStart = 0;
+	int traceEventCount = 0;
+	int traceEventCapacity = 0;
+	TraceEvent* traceEvents = NULL;
 };
 
-class Bullet : public GameObject
+void StartTracing(Profiler* profiler)
 {
-public:
-	Vector2 speed = {};
-};
+	profiler->tracing = true;
+	profiler->traceStart = SDL_GetPerformanceCounter();
+	profiler->frameStart = profiler->traceStart;
+}
 
-struct GameData
+// make room for count more events, so tracing them doesn't allocate
+// returns false when tracing is off or has run out of memory
+bool ReserveTraceEvents(Profiler* profiler, int count)
 {
-	double gameOverTime = 0;
+	if (!profiler->tracing) return false;
+	if (profiler->traceEventCount + count <= profiler->traceEventCapacity)
+		return true;
+
+	int capacity = __max(profiler->traceEventCapacity * 2, 4096);
+	capacity = __max(capacity, profiler->traceEventCount + count);
+	TraceEvent* events = (TraceEvent*)CountedRealloc(profiler->traceEvents, sizeof(TraceEvent) * capacity);
+	if (events == NULL)
+	{
+		printf("Ran out of memory when tracing, the rest of the run won't be traced!\n");
+		profiler->tracing = false;
+		return false;
+	}
+	profiler->traceEvents = events;
+	profiler->traceEventCapacity = capacity;
+	return true;
+}
 
-	// game objects
-	Player* player = NULL;
-	int npcCount = 0;
-	NPC* npcs[MAX_NPCS] = {};
-	Bullet* bullets[MAX_BULLETS] = {};
-	GameObject* riflePowerup = NULL;
+void AddTraceEvent(Profiler* profiler, TraceEvent event)
+{
+	if (!ReserveTraceEvents(profiler, 1)) return;
+	profiler->traceEvents[profiler->traceEventCount] = event;
+	profiler->traceEventCount++;
+}
 
-	GameObject* background = NULL; 
-	GameObject* roadEdgeSegments[ROAD_EDGE_SEGMENTS * 2] = {};
+// measures the time between its creation and the end of its scope
+// does nothing when the profiler is NULL
+struct ProfileScope
+{
+	Profiler* profiler;
+	ProfilerStage stage;
+	Uint64 start;
 
-	// NPC spawning
-	double nextObjectSpawnTick = 0;
+	ProfileScope(Profiler* profiler, ProfilerStage stage)
+	{
+		this->profiler = profiler;
+		this->stage = stage;
+		start = profiler != NULL ? SDL_GetPerformanceCounter() : 0;
+	}
+	~ProfileScope()
+	{
+		if (profiler == NULL) return;
+		Uint64 end = SDL_GetPerformanceCounter();
+		profiler->current[stage] += (double)(end - start) / (double)SDL_GetPerformanceFrequency();
+		AddTraceEvent(profiler, { TRACE_STAGE, stage, start, end, 0, 0 });
+	}
 };
 
-
-
-
-
-//////////////////////////////////////////////////////////////////////////////////////
-// MEMORY MANAGEMENT
-
-void FreeBitmaps(SDL_Surface** bmps)
+// store the state of the game at the end of a frame in the trace
+void TraceCounters(Profiler* profiler, int npcCount, int visibleBullets)
 {
-	for (int i = 0; i < BMP_COUNT; i++)
-	{
-		SDL_FreeSurface(bmps[i]);
-	}
+	Uint64 now = SDL_GetPerformanceCounter();
+	AddTraceEvent(profiler, { TRACE_COUNTERS, STAGE_COUNT, now, now, npcCount, visibleBullets });
 }
 
-void FreeGameMemory(GameData* gameData)
+// store the measurements of the frame that has just ended
+void EndProfilerFrame(Profiler* profiler)
 {
-	delete gameData->background;
-	delete gameData->player;
+	Uint64 now = SDL_GetPerformanceCounter();
+	AddTraceEvent(profiler, { TRACE_FRAME, STAGE_COUNT, profiler->frameStart, now, 0, 0 });
+	profiler->frameStart = now;
 
-	for (int i = 0; i < MAX_BULLETS; i++)
-	{
-		delete gameData->bullets[i];
-	}
-	for (int i = 0; i < gameData->npcCount; i++)
+	for (int i = 0; i < STAGE_COUNT; i++)
 	{
-		delete gameData->npcs[i];
+		profiler->history[profiler->historyIndex][i] = profiler->current[i];
+		profiler->current[i] = 0;
 	}
+	profiler->copiedBytes[profiler->historyIndex] = profiler->currentCopiedBytes;
+	profiler->currentCopiedBytes = 0;
+	profiler->historyIndex = (profiler->historyIndex + 1) % PROFILER_HISTORY;
+	if (profiler->historyCount < PROFILER_HISTORY)
+		profiler->historyCount++;
 }
 
+// returns the time of a stage in the given frame, 0 is the oldest stored frame
+// STAGE_COUNT returns the sum of all stages
+double GetProfiledTime(Profiler* profiler, int frame, int stage)
+{
+	int index = (profiler->historyIndex - profiler->historyCount + frame + PROFILER_HISTORY) % PROFILER_HISTORY;
+	if (stage < STAGE_COUNT)
+		return profiler->history[index][stage];
+
+	double sum = 0;
+	for (int i = 0; i < STAGE_COUNT; i++)
+		sum += profiler->history[index][i];
+	return sum;
+}
 
+double GetAverageCopiedBytes(Profiler* profiler)
+{
+	if (profiler->historyCount == 0) return 0;
 
+	double sum = 0;
+	for (int i = 0; i < profiler->historyCount; i++)
+		sum += profiler->copiedBytes[i];
+	return sum / profiler->historyCount;
+}
 
+// write the trace in the chrome://tracing JSON format (it can also be opened in Perfetto)
+// returns true when successful
+bool WriteTrace(Profiler* profiler, const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+	{
+		printf("Couldn't open %s for writing the trace\n", filename);
+		return false;
+	}
 
-//////////////////////////////////////////////////////////////////////////////////////
-// ROAD SHAPE GENERATION
+	// timestamps are in microseconds from the start of the trace
+	double toMicroseconds = 1000000.0 / (double)SDL_GetPerformanceFrequency();
 
-// returns a pseudo random value between -1 and 1
-double PseudoNoise(double x)
-{
-	return (sin(x * M_PI) + sin(x * 2)) * 0.5 * sin(x);
-}
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", WINDOW_TITLE);
+	for (int i = 0; i < profiler->traceEventCount; i++)
+	{
+		TraceEvent* event = &profiler->traceEvents[i];
+		double ts = (event->start - profiler->traceStart) * toMicroseconds;
+		double dur = (event->end - event->start) * toMicroseconds;
+		switch (event->type)
+		{
+		case TRACE_STAGE:
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+				PROFILER_STAGE_NAMES[event->stage], ts, dur);
+			break;
+		case TRACE_FRAME:
+			fprintf(file, ",\n{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+				ts, dur);
+			break;
+		case TRACE_COUNTERS:
+			fprintf(file, ",\n{\"name\":\"npcCount\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"npcCount\":%d}}",
+				ts, event->npcCount);
+			fprintf(file, ",\n{\"name\":\"visibleBullets\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"visibleBullets\":%d}}",
+				ts, event->visibleBullets);
+			break;
+		default:
+			break;
+		}
+	}
+	fprintf(file, "\n]}\n");
 
-double GetRoadCenter(double distance)
-{
-	return PseudoNoise(distance * ROAD_BEND_FREQUENCY) * ROAD_CENTER_VARIATION;
+	bool success = !ferror(file);
+	fclose(file);
+
+	if (success)
+		printf("Saved trace %s (%d events)\n", filename, profiler->traceEventCount);
+	else
+		printf("Error while writing the trace %s\n", filename);
+	return success;
 }
-double GetRoadWidth(double distance)
+
+void FreeProfiler(Profiler* profiler)
 {
-	return ROAD_MIN_WIDTH + (PseudoNoise(distance * ROAD_WIDTH_FREQUENCY) + 1) / 2 * (ROAD_MAX_WIDTH - ROAD_MIN_WIDTH);
+	free(profiler->traceEvents);
+	profiler->traceEvents = NULL;
+	profiler->traceEventCount = 0;
+	profiler->traceEventCapacity = 0;
+	profiler->tracing = false;
 }
 
-double GetRoadEdgeLeft(double distance)
+struct StageStats
 {
-	return SCREEN_WIDTH / 2 + GetRoadCenter(distance) - GetRoadWidth(distance) * 0.5;
-}
-double GetRoadEdgeRight(double distance)
+	double min;
+	double avg;
+	double p99;
+};
+
+int CompareDoubles(const void* a, const void* b)
 {
-	return SCREEN_WIDTH / 2 + GetRoadCenter(distance) + GetRoadWidth(distance) * 0.5;
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
 }
 
-bool IsOnRoad(Vector2 pos, double distance)
+// statistics of a stage over the stored frames, STAGE_COUNT gives statistics of whole frames
+StageStats CalculateStageStats(Profiler* profiler, int stage)
 {
-	if (GetRoadEdgeLeft(distance - pos.y) > pos.x || GetRoadEdgeRight(distance - pos.y) < pos.x)
+	StageStats stats = {};
+	if (profiler->historyCount == 0)
+		return stats;
+
+	double values[PROFILER_HISTORY];
+	double sum = 0;
+	for (int i = 0; i < profiler->historyCount; i++)
 	{
-		return false;
+		values[i] = GetProfiledTime(profiler, i, stage);
+		sum += values[i];
 	}
-	return true;
-}
+	qsort(values, profiler->historyCount, sizeof(double), CompareDoubles);
 
+	stats.min = values[0];
+	stats.avg = sum / profiler->historyCount;
+	stats.p99 = values[(int)ceil(profiler->historyCount * 0.99) - 1];
+	return stats;
+}
 
 
 //////////////////////////////////////////////////////////////////////////////////////
-// GAME MECHANICS
+// RENDERING
+
+// RENDER_SURFACE blits every sprite into the screen surface, which is then copied to a streaming texture
+// (with --renderer locked the sprites are blitted straight into the locked streaming texture, see LockedFrame)
+// RENDER_TEXTURE keeps the sprites in textures and draws them with SDL_RenderCopy
+enum RenderMode
+{
+	RENDER_SURFACE,
+	RENDER_TEXTURE,
+};
 
+struct TextCache;
 
-void CreateNPC(GameData* gameData, SDL_Surface** bitmaps, Vector2 pos, NPCType type)
+enum DrawCommandType
 {
-	if (gameData->npcCount >= MAX_NPCS)
-	{
-		printf("Couldn't create a new npc - max npc count reached\n");
+	DRAW_SPRITE,
+	DRAW_SPAN,
+	DRAW_FILL,
+	DRAW_TEXT,
+};
 
-		return;
-	}
+// one call to a drawing function, with everything needed to repeat it
+struct DrawCommand
+{
+	DrawCommandType type;
+	SDL_Rect dest; // spans only use x, y and w
+	SDL_Surface* sprite;
+	SDL_Rect src; // spans only use x and y
+	Uint32 color; // 0xRRGGBB
+	TextCache* cache;
+	int text; // where the text starts in DrawList::text
+};
 
-	NPC* npc = new NPC();
-	npc->position = pos;
-	npc->deathTime = 0;
-	npc->size = CAR_SIZE;
-	npc->explosion0 = bitmaps[BMP_EXPLOSION_0];
-	npc->explosion1 = bitmaps[BMP_EXPLOSION_1];
+// the drawing of a whole frame, compared with the previous frame to find out what has changed
+// texts are compared by their characters, a cached text's surface can be reused for another text
+struct DrawList
+{
+	DrawCommand* commands = NULL;
+	int count = 0;
+	int capacity = 0;
+	char* text = NULL;
+	int textLength = 0;
+	int textCapacity = 0;
+	bool failed = false; // ran out of memory, some of the commands are missing
+};
 
-	npc->type = type;
-	switch (type)
-	{
-	case ENEMY:
-		npc->speed = { 0, -ENEMY_MAX_SPEED };
-		npc->sprite = bitmaps[BMP_ENEMY_CAR];
-		npc->health = ENEMY_HP;
-		break;
-	case CIVILIAN:
-		npc->speed = { 0, -CIVILIAN_SPEED };
-		npc->sprite = bitmaps[BMP_CIVILIAN_CAR];
-		npc->health = CIVILIAN_HP;
-		break;
-	default:
-		break;
-	}
-	gameData->npcs[gameData->npcCount] = npc;
-	gameData->npcCount++;
-}
-void DeleteNPC(GameData* gameData, int npcIndex)
+// everything the drawing functions need to know about where the frame goes
+struct Canvas
 {
-	// if the deleted npc isn't the last one in the array
-	// move the last one into it's place
-	// like this:
-	// ##D##L
-	//     / 
-	//    /  
-	// ##L## 
+	RenderMode mode;
+	SDL_Surface* screen; // only used in RENDER_SURFACE mode
+	SDL_Renderer* renderer;
+	int w;
+	int h;
+	DrawList* list; // when not NULL, the drawing functions only record into it, see ReplayDrawList
+};
 
-	NPCType type = gameData->npcs[npcIndex]->type;
-	delete gameData->npcs[npcIndex];
+// in RENDER_TEXTURE mode every sprite keeps one of these in the userdata of its surface
+// sprites from the atlas share one texture, each one is a different rectangle of it
+struct SpriteTexture
+{
+	SDL_Texture* texture;
+	SDL_Rect rect;
+};
 
-	gameData->npcCount--;
-	if (npcIndex != gameData->npcCount)
-	{
-		gameData->npcs[npcIndex] = gameData->npcs[gameData->npcCount];
-	}
-}
+// with a locked frame the software frame is drawn straight into the pixels of the streaming texture,
+// which saves copying the whole screen surface into the texture every frame
+// the texture's pixels aren't kept between locks, every frame has to cover the whole screen
+struct LockedFrame
+{
+	SDL_Texture* texture = NULL;
+	SDL_Surface* view = NULL; // points at the locked pixels
+};
 
-void KillCar(Car* car, Time time)
+// lock the texture and make the canvas draw into it
+// returns true when successful
+bool LockFrame(LockedFrame* frame, Canvas* canvas)
 {
-	if (!car->IsDead())
+	void* pixels = NULL;
+	int pitch = 0;
+	if (SDL_LockTexture(frame->texture, NULL, &pixels, &pitch) != 0)
 	{
-		car->deathTime = time.gametime;
+		printf("SDL_LockTexture error: %s\n", SDL_GetError());
+		return false;
 	}
-}
-void DamageNPC(int damage, NPC* npc, Time time)
-{
-	npc->health -= damage;
-	if (npc->health <= 0)
+
+	// the pixels can move between locks, the view only has to be recreated when the pitch changes
+	if (frame->view == NULL || frame->view->pitch != pitch)
 	{
-		KillCar(npc, time);
+		SDL_FreeSurface(frame->view);
+		frame->view = SDL_CreateRGBSurfaceWithFormatFrom(pixels, canvas->w, canvas->h, 32, pitch, SDL_PIXELFORMAT_ARGB8888);
+		if (frame->view == NULL)
+		{
+			printf("SDL_CreateRGBSurfaceWithFormatFrom error: %s\n", SDL_GetError());
+			SDL_UnlockTexture(frame->texture);
+			return false;
+		}
 	}
+	frame->view->pixels = pixels;
+	canvas->screen = frame->view;
+	return true;
 }
 
-double CalculateMaxSideSpeed(double forwardSpeed, double maxForwardSpeed, double maxSideSpeed)
+void FreeLockedFrame(LockedFrame* frame)
 {
-	return (forwardSpeed / maxForwardSpeed) * maxSideSpeed;
+	SDL_FreeSurface(frame->view);
+	*frame = LockedFrame();
 }
 
-void PlayerSteering(Player* player, Time time, Input* input)
+void ClearDrawList(DrawList* list)
 {
-	// convert input into a direction vector
-	Vector2 steering = { 0,0 };
-	if (input->up) steering.y--;
-	if (input->down) steering.y++;
-	if (input->left) steering.x--;
-	if (input->right) steering.x++;
-
-	// accelerate / decelerate and steer the car
-	if (steering.x == 0)
-		MoveTowards(&player->speed.x, 0, time.delta * PLAYER_IDLE_ACCEL_SIDES);
-	else
-		MoveTowards(&player->speed.x, 
-			steering.x * CalculateMaxSideSpeed(-player->speed.y, PLAYER_MAX_SPEED, PLAYER_MAX_SPEED_SIDES),
-			time.delta * PLAYER_ACCEL_SIDES);
-
-	player->speed.y += steering.y * time.delta * PLAYER_ACCEL;
-	player->speed.y = Clamp(player->speed.y, -PLAYER_MAX_SPEED, -PLAYER_MIN_SPEED);
-
-	// the player doesn't move along the y axis, the rest of the world does
-	player->position.x += player->speed.x * time.delta;
-	MoveTowards(&player->position.y, PLAYER_Y_POS, time.delta * PLAYER_START_SPEED);
-	player->distanceCounter -= player->speed.y * time.delta;
+	list->count = 0;
+	list->textLength = 0;
+	list->failed = false;
 }
 
-void PlayerShoot(Bullet* bullets[MAX_BULLETS], Vector2 pos, Vector2 speed)
+void FreeDrawList(DrawList* list)
 {
-	for (int i = 0; i < MAX_BULLETS; i++)
-	{
-		if (!bullets[i]->visible)
-		{
-			bullets[i]->visible = true;
-			bullets[i]->position = pos;
-			bullets[i]->speed = speed;
-			break;
-		}
-	}
+	free(list->commands);
+	free(list->text);
+	*list = DrawList();
 }
-void PlayerShooting(GameData* gameData, Time time, Input* input)
+
+// add the command to the canvas' draw list, text is copied into the list when it isn't NULL
+// returns true when the command was recorded instead of being drawn
+bool RecordDrawCommand(Canvas* canvas, DrawCommand command, const char* text)
 {
-	if (input->shoot && gameData->player->nextShootTime <= time.gametime)
+	DrawList* list = canvas->list;
+	if (list == NULL) return false;
+	if (list->failed) return true;
+
+	if (list->count >= list->capacity)
 	{
-		Vector2 speed = { 0, -BULLET_SPEED };
-		if (gameData->player->rifleAmmo > 0)
+		int capacity = __max(list->capacity * 2, 256);
+		DrawCommand* commands = (DrawCommand*)CountedRealloc(list->commands, sizeof(DrawCommand) * capacity);
+		if (commands == NULL)
 		{
-			gameData->player->nextShootTime = time.gametime + PLAYER_FIRE_INTERVAL / 2;
-			speed.y *= 2;
+			printf("Ran out of memory when recording the frame!\n");
+			list->failed = true;
+			return true;
 		}
-		else
-			gameData->player->nextShootTime = time.gametime + PLAYER_FIRE_INTERVAL;
-
-		PlayerShoot(gameData->bullets, gameData->player->position, speed);
-
-		gameData->player->rifleAmmo--;
+		list->commands = commands;
+		list->capacity = capacity;
 	}
-}
 
-void AddScore(int points, Player* player, Time time)
-{
-	if (player->scorePenalty <= time.gametime && !player->IsDead())
+	if (text != NULL)
 	{
-		player->score += points;
-
-		player->lifeScoreCounter += points;
-		if (player->lifeScoreCounter >= POINTS_PER_LIFE)
+		int length = (int)strlen(text) + 1;
+		if (list->textLength + length > list->textCapacity)
 		{
-			player->lives++;
-			player->lifeScoreCounter -= POINTS_PER_LIFE;
+			int capacity = __max(list->textCapacity * 2, list->textLength + length);
+			capacity = __max(capacity, 1024);
+			char* buffer = (char*)CountedRealloc(list->text, capacity);
+			if (buffer == NULL)
+			{
+				printf("Ran out of memory when recording the frame!\n");
+				list->failed = true;
+				return true;
+			}
+			list->text = buffer;
+			list->textCapacity = capacity;
 		}
+		memcpy(list->text + list->textLength, text, length);
+		command.text = list->textLength;
+		list->textLength += length;
 	}
+
+	list->commands[list->count] = command;
+	list->count++;
+	return true;
 }
-void CountScorePerDistance(Player* player, Time time)
+
+// copy a part of a sprite (the whole sprite when src is NULL) onto the canvas
+// src has to lie inside the sprite, in texture mode it isn't clipped to the sprite's edges
+void BlitSprite(Canvas* canvas, SDL_Surface* sprite, SDL_Rect* src, SDL_Rect* dest)
 {
-	// count the score based on distance
-	player->scoringDistanceCounter -= player->speed.y * time.delta;
-	if (player->scoringDistanceCounter >= DISTANCE_TO_SCORE)
+	SDL_Rect part = src != NULL ? *src : SDL_Rect{ 0, 0, sprite->w, sprite->h };
+	if (RecordDrawCommand(canvas, { DRAW_SPRITE, *dest, sprite, part, 0, NULL, 0 }, NULL))
+		return;
+
+	if (canvas->mode == RENDER_SURFACE)
 	{
-		AddScore(SCORE_PER_DISTANCE, player, time);
-		player->scoringDistanceCounter = 0;
+		SDL_BlitSurface(sprite, src, canvas->screen, dest);
+		return;
 	}
-}
 
-
-void EnemyAI(NPC* npc, Player* player, Time time)
-{
-	if (fabs(npc->position.y - player->position.y) < ENEMY_TARGET_DISTANCE)
+	SpriteTexture* spriteTexture = (SpriteTexture*)sprite->userdata;
+	if (spriteTexture == NULL)
 	{
-		// match the players speed
-		MoveTowards(&npc->speed.y, player->speed.y - (npc->position.y - player->position.y), time.delta * ENEMY_ACCEL);
-
-		// try to push the player off the road
-		MoveTowards(&npc->speed.x,
-			Sign(player->position.x - npc->position.x) * CalculateMaxSideSpeed(-npc->speed.y, ENEMY_MAX_SPEED, ENEMY_MAX_SPEED_SIDES),
-			time.delta * ENEMY_ACCEL_SIDES);
+		printf("Error while drawing a sprite: it has no texture\n");
+		return;
 	}
-	else
-	{
-		// avoid road edges
-		if (!IsOnRoad({npc->position.x + NPC_EDGE_DISTANCE, npc->position.y}, player->distanceCounter))
-			MoveTowards(&npc->speed.x, -ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
-		else if (!IsOnRoad({ npc->position.x - NPC_EDGE_DISTANCE, npc->position.y }, player->distanceCounter))
-			MoveTowards(&npc->speed.x, ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
-		else
-			MoveTowards(&npc->speed.x, 0, time.delta * ENEMY_ACCEL_SIDES);
 
-		// catch up or wait for the player
-		if (npc->position.y < player->position.y)
-			MoveTowards(&npc->speed.y, player->speed.y + ENEMY_BRAKING, time.delta * ENEMY_ACCEL);
-		else
-			MoveTowards(&npc->speed.y, -ENEMY_MAX_SPEED, time.delta * ENEMY_ACCEL);
+	SDL_Rect rect = spriteTexture->rect;
+	if (src != NULL)
+	{
+		rect.x += src->x;
+		rect.y += src->y;
+		rect.w = src->w;
+		rect.h = src->h;
 	}
-
-
-	npc->speed.y = Clamp(npc->speed.y, -ENEMY_MAX_SPEED, -ENEMY_MIN_SPEED);
+	SDL_RenderCopy(canvas->renderer, spriteTexture->texture, &rect, dest);
 }
-void CivilianAI(NPC* npc, Time time, double distance)
-{
-	// avoid road edges
-	if (!IsOnRoad({ npc->position.x + NPC_EDGE_DISTANCE, npc->position.y }, distance))
-		MoveTowards(&npc->speed.x, -ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
-	else if (!IsOnRoad({ npc->position.x - NPC_EDGE_DISTANCE, npc->position.y }, distance))
-		MoveTowards(&npc->speed.x, ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
-	else
-		MoveTowards(&npc->speed.x, 0, time.delta * ENEMY_ACCEL_SIDES);
 
-	MoveTowards(&npc->speed.y, -CIVILIAN_SPEED, time.delta * CIVILIAN_ACCEL);
-}
-void UpdateNPC(NPC* npc, Player* player, Time time)
+// top left corner of a text of the given length, offset by (x, y) from the anchor
+SDL_Point GetTextPosition(Canvas* canvas, Vector2 offset, int length, UIAnchor anchor)
 {
-	if (!npc->IsDead())
+	int x = offset.x;
+	int y = offset.y;
+	Vector2 size = { (double)length * 8, 8 };
+
+	switch (anchor)
 	{
-		switch (npc->type)
-		{
-		case ENEMY:
-			EnemyAI(npc, player, time);
-			break;
-		case CIVILIAN:
-			CivilianAI(npc, time, player->distanceCounter);
-			break;
-		default:
-			break;
-		}
+	case CENTER:
+		x += canvas->w / 2 - size.x / 2;
+		y += canvas->h / 2 - size.y / 2;
+		break;
+	case UPPER_LEFT:
+		break;
+	case UPPER_RIGHT:
+		x += canvas->w - size.x;
+		break;
+	case LOWER_LEFT:
+		y += canvas->h - size.y;
+		break;
+	case LOWER_RIGHT:
+		x += canvas->w - size.x;
+		y += canvas->h - size.y;
+		break;
+	case MIDDLE_LEFT:
+		y += canvas->h / 2 - size.y / 2;
+		break;
+	case MIDDLE_RIGHT:
+		x += canvas->w - size.x;
+		y += canvas->h / 2 - size.y / 2;
+		break;
+	case UPPER_CENTER:
+		x += canvas->w / 2 - size.x / 2;
+		break;
+	case LOWER_CENTER:
+		x += canvas->w / 2 - size.x / 2;
+		y += canvas->h - size.y;
+		break;
+	default:
+		break;
 	}
-	else
+	return { x, y };
+}
+
+// draw a text one character at a time with its top left corner in (x, y)
+// charset is a 128x128 bitmap containing character images
+void DrawGlyphs(Canvas* canvas, int x, int y, const char* text, SDL_Surface* charset)
+{
+	int px, py, c;
+	SDL_Rect s, d;
+	s.w = 8;
+	s.h = 8;
+	d.w = 8;
+	d.h = 8;
+	while (*text)
 	{
-		MoveTowards(&npc->speed.x, 0, EXPLOSION_FRICTION * time.delta);
-		MoveTowards(&npc->speed.y, 0, EXPLOSION_FRICTION * time.delta);
+		c = *text;
+		px = (c % 16) * 8;
+		py = (c / 16) * 8;
+		s.x = px;
+		s.y = py;
+		d.x = x;
+		d.y = y;
+		BlitSprite(canvas, charset, &s, &d);
+		x += 8;
+		text++;
 	}
+}
 
-	npc->position.x += npc->speed.x * time.delta;
-	npc->position.y += (npc->speed.y - player->speed.y) * time.delta;
+// draw a text on the canvas, offset by (x, y) from the anchor
+// used for text that changes every frame, anything else should be drawn with DrawCachedString
+void DrawString(Canvas* canvas, Vector2 offset, const char* text, SDL_Surface* charset, UIAnchor anchor)
+{
+	SDL_Point position = GetTextPosition(canvas, offset, (int)strlen(text), anchor);
+	DrawGlyphs(canvas, position.x, position.y, text, charset);
 }
 
+// a text rendered once into its own surface (and texture in RENDER_TEXTURE mode)
+struct CachedText
+{
+	char text[STRING_BUFFER_SIZE];
+	int length;
+	SDL_Surface* surface;
+	Uint64 lastUse;
+};
 
-void MoveRoad(GameObject* roadEdgeSegments[ROAD_EDGE_SEGMENTS * 2], GameObject* background, double playerSpeed, double distance, Time time)
+// the most recently drawn texts, so a text is drawn with one blit instead of one per character
+// when the cache is full the least recently used text is replaced
+struct TextCache
 {
-	background->position.y -= playerSpeed * time.delta;
-	if (background->position.y > SCREEN_HEIGHT)
-		background->position.y = 0;
+	SDL_Surface* charset = NULL;
+	CachedText entries[TEXT_CACHE_SIZE] = {};
+	int count = 0;
+	Uint64 uses = 0;
+};
 
-	for (int i = 0; i < ROAD_EDGE_SEGMENTS * 2; i++)
+void FreeCachedText(CachedText* entry)
+{
+	if (entry->surface != NULL)
 	{
-		roadEdgeSegments[i]->position.y -= playerSpeed * (double)time.delta;
-		double halfOfSegment = SCREEN_HEIGHT / ((ROAD_EDGE_SEGMENTS - 1) * 2);
-		if (roadEdgeSegments[i]->position.y > SCREEN_HEIGHT + halfOfSegment)
-		{
-			roadEdgeSegments[i]->position.y -= SCREEN_HEIGHT + halfOfSegment * 2;
-			if (i % 2)
-				roadEdgeSegments[i]->position.x = GetRoadEdgeRight(distance) + ROAD_EDGE_WIDTH / 2;
-			else
-				roadEdgeSegments[i]->position.x = GetRoadEdgeLeft(distance) - ROAD_EDGE_WIDTH / 2;
-		}
+		SpriteTexture* spriteTexture = (SpriteTexture*)entry->surface->userdata;
+		if (spriteTexture != NULL)
+			SDL_DestroyTexture(spriteTexture->texture);
+		free(spriteTexture);
+		SDL_FreeSurface(entry->surface);
 	}
+	*entry = CachedText();
 }
 
-
-
-double GetRandomSpawnPos(double distance)
+// has to be called before the renderer is destroyed
+void FreeTextCache(TextCache* cache)
 {
-	return RandRange(GetRoadEdgeLeft(distance + OBJECT_SPAWN_MARGIN), GetRoadEdgeRight(distance + OBJECT_SPAWN_MARGIN));
+	for (int i = 0; i < cache->count; i++)
+		FreeCachedText(&cache->entries[i]);
+	cache->count = 0;
 }
-void ObjectSpawning(GameData* gameData, SDL_Surface** bitmaps, Time time)
+
+// draw the characters of the text into a new surface, keyed like the charset
+// in RENDER_TEXTURE mode the surface also gets a texture
+// returns NULL when unsuccessful
+SDL_Surface* RenderText(Canvas* canvas, SDL_Surface* charset, const char* text, int length)
 {
-	if (gameData->nextObjectSpawnTick <= time.gametime)
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, length * 8, 8, 32, SDL_PIXELFORMAT_ARGB8888);
+	if (surface == NULL)
 	{
-		gameData->nextObjectSpawnTick = time.gametime + OBJECT_SPAWN_TICK_INTERVAL;
+		printf("SDL_CreateRGBSurfaceWithFormat error: %s\n", SDL_GetError());
+		return NULL;
+	}
+	Canvas textCanvas = { RENDER_SURFACE, surface, NULL, surface->w, surface->h, NULL };
+	DrawGlyphs(&textCanvas, 0, 0, text, charset);
+	SDL_SetColorKey(surface, true, 0x000000);
 
-		if (RandVal() < (1.0 / (__max(gameData->npcCount, 1))))
-		{
-			NPCType type = ENEMY;
-			if (gameData->npcCount >= 2 && rand() % 2)
-			{
-				 type = CIVILIAN;
-			}
+	if (canvas->mode == RENDER_SURFACE)
+	{
+		SDL_SetSurfaceRLE(surface, 1);
+		return surface;
+	}
 
-			CreateNPC(gameData, bitmaps, { GetRandomSpawnPos(gameData->player->distanceCounter), -OBJECT_SPAWN_MARGIN }, type);
-		}
+	SpriteTexture* spriteTexture = (SpriteTexture*)CountedMalloc(sizeof(SpriteTexture));
+	if (spriteTexture != NULL)
+		spriteTexture->texture = SDL_CreateTextureFromSurface(canvas->renderer, surface);
+	if (spriteTexture == NULL || spriteTexture->texture == NULL)
+	{
+		printf("Couldn't create a texture for the text %s\n", text);
+		free(spriteTexture);
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	spriteTexture->rect = { 0, 0, surface->w, surface->h };
+	surface->userdata = spriteTexture;
+	return surface;
+}
 
-		if (RandVal() < POWERUP_SPAWN_CHANCE)
+// returns the rendered text, rendering it when it isn't in the cache yet
+// returns NULL when the text can't be cached
+SDL_Surface* GetCachedText(Canvas* canvas, TextCache* cache, const char* text)
+{
+	int length = (int)strlen(text);
+	if (length == 0 || length >= STRING_BUFFER_SIZE)
+		return NULL;
+
+	cache->uses++;
+	CachedText* oldest = NULL;
+	for (int i = 0; i < cache->count; i++)
+	{
+		CachedText* entry = &cache->entries[i];
+		if (entry->length == length && memcmp(entry->text, text, length) == 0)
 		{
-			if (!gameData->riflePowerup->visible)
-			{
-				gameData->riflePowerup->visible = true;
-				gameData->riflePowerup->position = { GetRandomSpawnPos(gameData->player->distanceCounter), -OBJECT_SPAWN_MARGIN };
-			}
+			entry->lastUse = cache->uses;
+			return entry->surface;
 		}
+		if (oldest == NULL || entry->lastUse < oldest->lastUse)
+			oldest = entry;
 	}
+
+	CachedText* entry = cache->count < TEXT_CACHE_SIZE ? &cache->entries[cache->count++] : oldest;
+	FreeCachedText(entry);
+	entry->surface = RenderText(canvas, cache->charset, text, length);
+	if (entry->surface == NULL)
+		return NULL;
+	memcpy(entry->text, text, length + 1);
+	entry->length = length;
+	entry->lastUse = cache->uses;
+	return entry->surface;
 }
 
+// draw a text with its top left corner in (x, y) from the text cache
+void DrawCachedStringAt(Canvas* canvas, TextCache* cache, int x, int y, const char* text)
+{
+	SDL_Rect bounds = { x, y, (int)strlen(text) * 8, 8 };
+	if (RecordDrawCommand(canvas, { DRAW_TEXT, bounds, NULL, {}, 0, cache, 0 }, text))
+		return;
+
+	SDL_Surface* surface = GetCachedText(canvas, cache, text);
+	if (surface == NULL)
+	{
+		DrawGlyphs(canvas, x, y, text, cache->charset);
+		return;
+	}
+	SDL_Rect dest = { x, y, surface->w, surface->h };
+	BlitSprite(canvas, surface, NULL, &dest);
+}
 
-Vector2 CalculateOverlap(GameObject* go1, GameObject* go2)
+// draw a text on the canvas, offset by (x, y) from the anchor, from the text cache
+void DrawCachedString(Canvas* canvas, TextCache* cache, Vector2 offset, const char* text, UIAnchor anchor)
 {
-	Vector2 overlap = {};
-	overlap.x = (go1->size.x + go2->size.x) * 0.5 - fabs(go1->position.x - go2->position.x);
-	overlap.y = (go1->size.y + go2->size.y) * 0.5 - fabs(go1->position.y - go2->position.y);
-	return overlap;
+	SDL_Point position = GetTextPosition(canvas, offset, (int)strlen(text), anchor);
+	DrawCachedStringAt(canvas, cache, position.x, position.y, text);
 }
-bool IsOverlapping(GameObject* go1, GameObject* go2)
+
+// draw a sprite on the canvas in point (x, y)
+// (x, y) is the center of sprite on screen
+void DrawSurface(Canvas* canvas, SDL_Surface* sprite, int x, int y)
 {
-	Vector2 overlap = CalculateOverlap(go1, go2);
-	return overlap.x > 0 && overlap.y > 0;
+	SDL_Rect dest;
+	dest.x = x - sprite->w / 2;
+	dest.y = y - sprite->h / 2;
+	dest.w = sprite->w;
+	dest.h = sprite->h;
+	BlitSprite(canvas, sprite, NULL, &dest);
 }
 
-void CheckCollision(Car* car1, Car* car2, Time time)
+// draw a single row of length w from a sprite at (x, y) on the canvas
+// the sprite is repeated when the row goes past its edge
+void DrawSpan(Canvas* canvas, SDL_Surface* sprite, int srcX, int srcY, int x, int y, int w)
 {
-	if (car1->IsDead() || car2->IsDead())
+	if (RecordDrawCommand(canvas, { DRAW_SPAN, { x, y, w, 1 }, sprite, { srcX, srcY, 0, 0 }, 0, NULL, 0 }, NULL))
 		return;
 
-	Vector2 overlap = CalculateOverlap(car1, car2);
-	if (overlap.x >= 0 && overlap.y >= 0)
+	srcY %= sprite->h;
+	if (srcY < 0) srcY += sprite->h;
+	srcX %= sprite->w;
+	if (srcX < 0) srcX += sprite->w;
+
+	// same pixel format as the screen, the pixels can be copied directly
+	bool copy = canvas->mode == RENDER_SURFACE && !SDL_MUSTLOCK(sprite) &&
+		sprite->format->format == canvas->screen->format->format;
+
+	while (w > 0)
 	{
-		if (fabs(car1->position.x - car2->position.x) >= (car1->size.x + car2->size.x) * 0.25)
+		int length = __min(w, sprite->w - srcX);
+		if (copy)
 		{
-			// horizontal collision
-			car1->position.x += (overlap.x + 1) * 0.5 * Sign(car1->position.x - car2->position.x);
-			car2->position.x += (overlap.x + 1) * 0.5 * -Sign(car1->position.x - car2->position.x);
-
-			double temp = car1->speed.x * COLLISION_BOUNCE;
-			car1->speed.x = car2->speed.x * COLLISION_BOUNCE;
-			car2->speed.x = temp;
+			int bpp = sprite->format->BytesPerPixel;
+			memcpy((Uint8*)canvas->screen->pixels + y * canvas->screen->pitch + x * bpp,
+				(Uint8*)sprite->pixels + srcY * sprite->pitch + srcX * bpp, length * bpp);
 		}
 		else
 		{
-			// vertical collision
-			car1->position.y += (overlap.y + 1) * 0.5 * Sign(car1->position.y - car2->position.y);
-			car2->position.y += (overlap.y + 1) * 0.5 * -Sign(car1->position.y - car2->position.y);
-
-
-			if (fabs(car1->speed.y - car2->speed.y) >= COLLISION_KILL_SPEED)
-			{
-				if (car1->position.y > car2->position.y)
-					KillCar(car1, time);
-				else
-					KillCar(car2, time);
-
-			}
-
-			double temp = car1->speed.y * COLLISION_BOUNCE;
-			car1->speed.y = car2->speed.y * COLLISION_BOUNCE;
-			car2->speed.y = temp;
+			SDL_Rect src = { srcX, srcY, length, 1 };
+			SDL_Rect dest = { x, y, length, 1 };
+			BlitSprite(canvas, sprite, &src, &dest);
 		}
+		x += length;
+		w -= length;
+		srcX = 0;
 	}
 }
-void ResolveCollisions(GameData* gameData, Time time)
+
+// fill a rectangle with a solid color
+void FillRectangle(Canvas* canvas, SDL_Rect rect, Uint8 r, Uint8 g, Uint8 b)
 {
-	for (int i = 0; i < gameData->npcCount; i++)
-	{
-		CheckCollision(gameData->player, gameData->npcs[i], time);
+	if (RecordDrawCommand(canvas, { DRAW_FILL, rect, NULL, {}, (Uint32)(r << 16 | g << 8 | b), NULL, 0 }, NULL))
+		return;
 
-		for (int j = 0; j < gameData->npcCount; j++)
-		{
-			CheckCollision(gameData->npcs[i], gameData->npcs[j], time);
-		}
+	if (canvas->mode == RENDER_SURFACE)
+	{
+		SDL_FillRect(canvas->screen, &rect, SDL_MapRGB(canvas->screen->format, r, g, b));
+		return;
 	}
+	SDL_SetRenderDrawColor(canvas->renderer, r, g, b, 255);
+	SDL_RenderFillRect(canvas->renderer, &rect);
+	SDL_SetRenderDrawColor(canvas->renderer, 0, 0, 0, 255);
 }
 
-bool IsGameOver(GameData* gameData)
+// draw a single pixel
+void DrawPixel(SDL_Surface* surface, int x, int y, Uint32 color)
 {
-	return gameData->gameOverTime != 0;
+	int bpp = surface->format->BytesPerPixel;
+	Uint8* p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
+	*(Uint32*)p = color;
 }
-void GameOver(GameData* gameData, Time time)
+
+// draw a vertical (when dx = 0, dy = 1) or horizontal (when dx = 1, dy = 0) line
+void DrawLine(SDL_Surface* screen, int x, int y, int l, int dx, int dy, Uint32 color)
 {
-	printf("GAME OVER!\n");
-	gameData->gameOverTime = time.gametime;
-	gameData->player->speed.y = 0;
+	for (int i = 0; i < l; i++)
+	{
+		DrawPixel(screen, x, y, color);
+		x += dx;
+		y += dy;
+	}
 }
 
-
-void RespawnPlayer(GameData* gameData, SDL_Surface** bitmaps)
+// draw a rectangle of size l by k
+void DrawRectangle(SDL_Surface* screen, int x, int y, int l, int k, Uint32 outlineColor, Uint32 fillColor)
 {
-	if (gameData->player->lives > 0)
-		gameData->player->lives--;
-
-	gameData->player->deathTime = 0;
-	gameData->player->sprite = bitmaps[BMP_PLAYER_CAR];
-	gameData->player->position = { SCREEN_WIDTH / 2, PLAYER_START_POS };
-	gameData->player->speed = {};
+	int i;
+	DrawLine(screen, x, y, k, 0, 1, outlineColor);
+	DrawLine(screen, x + l - 1, y, k, 0, 1, outlineColor);
+	DrawLine(screen, x, y, l, 1, 0, outlineColor);
+	DrawLine(screen, x, y + k - 1, l, 1, 0, outlineColor);
+	for (i = y + 1; i < y + k - 1; i++)
+		DrawLine(screen, x + 1, i, l - 2, 1, 0, fillColor);
 }
 
+// the part of the canvas the command draws over
+SDL_Rect GetCommandBounds(DrawCommand* command)
+{
+	if (command->type == DRAW_SPRITE)
+		return { command->dest.x, command->dest.y, command->src.w, command->src.h };
+	return command->dest;
+}
 
-void UpdatePlayer(Time time, GameData* gameData, SDL_Surface** bitmaps, Input* input)
+bool SameDrawCommand(DrawList* list, DrawCommand* command, DrawList* otherList, DrawCommand* other)
 {
-	if (!IsOnRoad(gameData->player->position, gameData->player->distanceCounter))
-		KillCar(gameData->player, time);
+	if (command->type != other->type || !SDL_RectEquals(&command->dest, &other->dest))
+		return false;
 
-	if (!gameData->player->IsDead())
+	switch (command->type)
 	{
-		PlayerSteering(gameData->player, time, input);
-		PlayerShooting(gameData, time, input);
-
-		MoveRoad(gameData->roadEdgeSegments, gameData->background, gameData->player->speed.y, gameData->player->distanceCounter, time);
-
-		CountScorePerDistance(gameData->player, time);
+	case DRAW_SPRITE:
+		return command->sprite == other->sprite && SDL_RectEquals(&command->src, &other->src);
+	case DRAW_SPAN:
+		return command->sprite == other->sprite && command->src.x == other->src.x && command->src.y == other->src.y;
+	case DRAW_FILL:
+		return command->color == other->color;
+	case DRAW_TEXT:
+		return command->cache == other->cache && strcmp(list->text + command->text, otherList->text + other->text) == 0;
+	}
+	return false;
+}
 
+// add a changed part of the canvas to the dirty rectangles, overlapping ones are merged
+// returns the new number of dirty rectangles
+int AddDirtyRect(Canvas* canvas, SDL_Rect* rects, int count, SDL_Rect rect)
+{
+	SDL_Rect screen = { 0, 0, canvas->w, canvas->h };
+	if (!SDL_IntersectRect(&rect, &screen, &rect))
+		return count;
 
-	}
-	else
+	for (int i = 0; i < count; i++)
 	{
-		gameData->player->speed.y = 0;
-		if (gameData->player->lives > 0 || time.gametime < INFINITE_LIVES_DURATION)
+		if (SDL_HasIntersection(&rects[i], &rect))
 		{
-			if (gameData->player->AnimateDeath(time))
-			{
-				RespawnPlayer(gameData, bitmaps);
-			}
+			SDL_UnionRect(&rects[i], &rect, &rect);
+			rects[i] = rects[--count];
+			i = -1; // the merged rectangle can overlap the ones already checked
 		}
-		else
-		{
-			if (gameData->player->AnimateDeath(time))
-				gameData->player->visible = false;
+	}
 
-			if (!IsGameOver(gameData))
-				GameOver(gameData, time);
-		}
+	if (count == DIRTY_RECT_LIMIT)
+	{
+		for (int i = 0; i < count; i++)
+			SDL_UnionRect(&rects[i], &rect, &rect);
+		count = 0;
 	}
+	rects[count] = rect;
+	return count + 1;
 }
-void UpdateNPCs(Time time, GameData* gameData)
+
+// the parts of the canvas where the frame differs from the previous one
+// commands are compared in the order they were drawn
+// returns the number of dirty rectangles, 0 when the frame is the same as the previous one
+int FindDirtyRects(Canvas* canvas, DrawList* frame, DrawList* previous, SDL_Rect* rects)
 {
-	for (int i = 0; i < gameData->npcCount; i++)
+	int count = 0;
+	for (int i = 0; i < __max(frame->count, previous->count); i++)
 	{
-		UpdateNPC(gameData->npcs[i], gameData->player, time);
-
-		if (!IsOnRoad(gameData->npcs[i]->position, gameData->player->distanceCounter))
-			KillCar(gameData->npcs[i], time);
-
-		if (gameData->npcs[i]->AnimateDeath(time))
-		{
-			switch (gameData->npcs[i]->type)
-			{
-			case ENEMY:
-				AddScore(SCORE_PER_ENEMY_KILL, gameData->player, time);
-				break;
-			case CIVILIAN:
-				gameData->player->scorePenalty = time.gametime + SCORE_PENALTY_DURATION;
-				break;
-			default:
-				break;
-			}
-
-			DeleteNPC(gameData, i);
-		}
-		else if (fabs(gameData->npcs[i]->position.y - SCREEN_HEIGHT / 2) >= OBJECT_DELETE_DISTANCE)
-		{
-			DeleteNPC(gameData, i);
-		}
+		DrawCommand* command = i < frame->count ? &frame->commands[i] : NULL;
+		DrawCommand* old = i < previous->count ? &previous->commands[i] : NULL;
+		if (command != NULL && old != NULL && SameDrawCommand(frame, command, previous, old))
+			continue;
+
+		if (command != NULL)
+			count = AddDirtyRect(canvas, rects, count, GetCommandBounds(command));
+		if (old != NULL)
+			count = AddDirtyRect(canvas, rects, count, GetCommandBounds(old));
 	}
-
+	return count;
 }
-void UpdateBullets(Time time, GameData* gameData)
+
+// draw the recorded commands on the canvas, the canvas must not record
+// when clip isn't NULL only that part of the screen surface is drawn
+void ReplayDrawList(Canvas* canvas, DrawList* list, SDL_Rect* clip)
 {
-	for (int i = 0; i < MAX_BULLETS; i++)
-	{
-		if (!gameData->bullets[i]->visible) continue;
+	if (clip != NULL)
+		SDL_SetClipRect(canvas->screen, clip);
 
-		gameData->bullets[i]->position.x += time.delta * gameData->bullets[i]->speed.x;
-		gameData->bullets[i]->position.y += time.delta * gameData->bullets[i]->speed.y;
+	for (int i = 0; i < list->count; i++)
+	{
+		DrawCommand* command = &list->commands[i];
+		SDL_Rect bounds = GetCommandBounds(command);
+		if (clip != NULL && !SDL_IntersectRect(&bounds, clip, &bounds))
+			continue;
 
-		for (int j = 0; j < gameData->npcCount; j++)
+		switch (command->type)
 		{
-			if (!gameData->npcs[j]->IsDead() && IsOverlapping(gameData->bullets[i], gameData->npcs[j]))
-			{
-				DamageNPC(1, gameData->npcs[j], time);
-				gameData->bullets[i]->visible = false;
-				break;
-			}
-		}
-		if (fabs(gameData->bullets[i]->position.y - gameData->player->position.y) > PLAYER_GUN_RANGE)
+		case DRAW_SPRITE:
 		{
-			gameData->bullets[i]->visible = false;
+			SDL_Rect dest = command->dest; // SDL_BlitSurface changes it
+			BlitSprite(canvas, command->sprite, &command->src, &dest);
+			break;
+		}
+		case DRAW_SPAN:
+			// spans are copied without looking at the clip rectangle, so only the clipped part is drawn
+			DrawSpan(canvas, command->sprite, command->src.x + bounds.x - command->dest.x, command->src.y,
+				bounds.x, bounds.y, bounds.w);
+			break;
+		case DRAW_FILL:
+			FillRectangle(canvas, command->dest, command->color >> 16, command->color >> 8 & 0xFF, command->color & 0xFF);
+			break;
+		case DRAW_TEXT:
+			DrawCachedStringAt(canvas, command->cache, command->dest.x, command->dest.y, list->text + command->text);
+			break;
 		}
 	}
+
+	if (clip != NULL)
+		SDL_SetClipRect(canvas->screen, NULL);
 }
-void UpdatePowerup(Time time, Player* player, GameObject* powerup)
-{
-	if (!powerup->visible) return;
 
-	powerup->position.y -= time.delta * player->speed.y;
 
-	if (!player->IsDead() && IsOverlapping(player, powerup))
-	{
-		player->rifleAmmo = RIFLE_BULLETS_PER_PICKUP;
-		powerup->visible = false;
-	}
-	
-	if (fabs(powerup->position.y - SCREEN_HEIGHT / 2) >= OBJECT_DELETE_DISTANCE)
-	{
-		powerup->visible = false;
-	}
-}
 
-// create all necessary GameObjects
-void GameStart(GameData* gameData, SDL_Surface** bitmaps)
-{
-	gameData->npcCount = 0;
 
-	GameObject* background = new GameObject();
-	background->sprite = bitmaps[BMP_BACKGROUND];
-	background->position = { SCREEN_WIDTH / 2, 0 };
-	gameData->background = background;
 
-	for (int i = 0; i < ROAD_EDGE_SEGMENTS * 2; i++)
+//////////////////////////////////////////////////////////////////////////////////////
+// LOADING IMAGES
+
+// when softwareRenderer is true, SDL's software renderer is used even if a GPU is available
+bool InitialiseSDL(SDL_Window** window, SDL_Renderer** renderer, SDL_Surface** screen, SDL_Texture** scrtex, bool softwareRenderer)
+{
+	if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
 	{
-		GameObject* edge = new GameObject();
-		edge->sprite = bitmaps[BMP_ROAD_EDGE];
-		double x = SCREEN_WIDTH / 2 - ROAD_MIN_WIDTH - ROAD_EDGE_WIDTH / 2 + (i % 2) * (2 * (ROAD_MIN_WIDTH)+ROAD_EDGE_WIDTH);
-		double y = ((i / 2) * SCREEN_HEIGHT / (ROAD_EDGE_SEGMENTS - 1));
-		edge->position = { x,y };
-		gameData->roadEdgeSegments[i] = edge;
+		printf("SDL_Init error: %s\n", SDL_GetError());
+		return false;
 	}
 
-	Player* player = new Player();
-	player->sprite = bitmaps[BMP_PLAYER_CAR];
-	player->lives = 0;
-	player->deathTime = 0;
-	player->explosion0 = bitmaps[BMP_EXPLOSION_0];
-	player->explosion1 = bitmaps[BMP_EXPLOSION_1];
-	player->position = { SCREEN_WIDTH / 2, PLAYER_START_POS };
-	player->size = CAR_SIZE;
-	gameData->player = player;
+	if (softwareRenderer)
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
 
-	for (int i = 0; i < MAX_BULLETS; i++)
-	{
-		Bullet* bullet = new Bullet();
-		bullet->visible = false;
-		bullet->sprite = bitmaps[BMP_BULLET];
-		bullet->size = BULLET_SIZE;
-		gameData->bullets[i] = bullet;
-	}
+	int error = -1;
 
-	GameObject* powerup = new GameObject();
+	if (FULLSCREEN)
+		error = SDL_CreateWindowAndRenderer(0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP, window, renderer);
+	else
+		error = SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, window, renderer);
+
+	if (error != 0)
+	{
+		SDL_Quit();
+		printf("SDL_CreateWindowAndRenderer error: %s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	SDL_RenderSetLogicalSize(*renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+	SDL_SetRenderDrawColor(*renderer, 0, 0, 0, 255);
+
+	SDL_SetWindowTitle(*window, WINDOW_TITLE);
+
+
+	*screen = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+
+	*scrtex = SDL_CreateTexture(*renderer, SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		SCREEN_WIDTH, SCREEN_HEIGHT);
+
+
+	SDL_ShowCursor(SDL_DISABLE);
+
+	return true;
+}
+
+// load a single sprite
+// returns true when successful
+bool LoadBitmap(SDL_Surface** surface, const char* filename)
+{
+	*surface = SDL_LoadBMP(filename);
+	if (*surface == NULL)
+	{
+		printf("SDL_LoadBMP(%s) error: %s\n", filename, SDL_GetError());
+		return false;
+	}
+	printf("SDL_LoadBMP(%s) bitmap loaded successfully\n", filename);
+	return true;
+}
+
+// indexes of all bitmaps
+// last element in the enum is used to get the number of other elements
+enum BitmapData
+{
+	BMP_CHARSET,
+	BMP_PLAYER_CAR,
+	BMP_ENEMY_CAR,
+	BMP_CIVILIAN_CAR,
+	BMP_EXPLOSION_0,
+	BMP_EXPLOSION_1,
+	BMP_BULLET,
+	BMP_RIFLE,
+	BMP_BACKGROUND,
+	BMP_ROAD_EDGE,
+	BMP_COUNT
+};
+
+// names of the sprites in the atlas and of their bitmaps, in the order of BitmapData
+const char* BITMAP_NAMES[BMP_COUNT] =
+{
+	"cs8x8",
+	"player_car",
+	"enemy_car",
+	"civilian_car",
+	"explosion_0",
+	"explosion_1",
+	"bullet",
+	"gun",
+	"background",
+	"road_edge",
+};
+
+// flags of a sprite in the atlas
+#define SPRITE_TRANSLUCENT 1 // has pixels that aren't fully opaque
+
+// the sprite atlas archive mapped into memory
+// when it's loaded every sprite surface is a view of its rectangle in the atlas pixels,
+// when it's missing the sprites are separate bitmaps and the atlas stays empty
+struct SpriteAtlas
+{
+	MappedFile file;
+	SDL_Surface* surface = NULL; // all the atlas pixels
+	SDL_Texture* texture = NULL; // RENDER_TEXTURE only, shared by all sprites
+	SDL_Rect rects[BMP_COUNT] = {}; // where every sprite is in the atlas
+};
+
+// a sprite placed in the atlas by PackSpriteAtlas
+struct PackedSprite
+{
+	char name[SPRITE_ATLAS_NAME_LENGTH];
+	SDL_Surface* surface;
+	SDL_Rect rect;
+	Uint32 flags;
+};
+
+// the sprite name is the file name without the directory and the extension
+void GetSpriteName(const char* filename, char* name)
+{
+	const char* start = filename;
+	for (const char* c = filename; *c; c++)
+	{
+		if (*c == '/' || *c == '\\')
+			start = c + 1;
+	}
+	int length = 0;
+	while (start[length] && start[length] != '.' && length < SPRITE_ATLAS_NAME_LENGTH - 1)
+	{
+		name[length] = start[length];
+		length++;
+	}
+	memset(name + length, 0, SPRITE_ATLAS_NAME_LENGTH - length);
+}
+
+// tallest sprites first, so every shelf of the atlas starts with its highest sprite
+int CompareSpriteHeights(const void* a, const void* b)
+{
+	const PackedSprite* x = (const PackedSprite*)a;
+	const PackedSprite* y = (const PackedSprite*)b;
+	if (x->surface->h != y->surface->h)
+		return y->surface->h - x->surface->h;
+	return strcmp(x->name, y->name);
+}
+
+Uint32 GetSpriteFlags(SDL_Surface* sprite)
+{
+	for (int y = 0; y < sprite->h; y++)
+	{
+		Uint32* row = (Uint32*)((Uint8*)sprite->pixels + y * sprite->pitch);
+		for (int x = 0; x < sprite->w; x++)
+		{
+			if ((row[x] & sprite->format->Amask) != sprite->format->Amask)
+				return SPRITE_TRANSLUCENT;
+		}
+	}
+	return 0;
+}
+
+// place the sprites left to right on shelves as tall as their first sprite
+// returns false when a sprite is too wide for the atlas
+bool PlaceSprites(PackedSprite* sprites, int count, int* atlasWidth, int* atlasHeight)
+{
+	qsort(sprites, count, sizeof(PackedSprite), CompareSpriteHeights);
+
+	int x = 0;
+	int y = 0;
+	int shelfHeight = 0;
+	int width = 0;
+	for (int i = 0; i < count; i++)
+	{
+		SDL_Surface* surface = sprites[i].surface;
+		if (surface->w > SPRITE_ATLAS_WIDTH)
+		{
+			printf("%s is wider than the atlas\n", sprites[i].name);
+			return false;
+		}
+		if (x + surface->w > SPRITE_ATLAS_WIDTH)
+		{
+			y += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+		sprites[i].rect = { x, y, surface->w, surface->h };
+		x += surface->w;
+		shelfHeight = __max(shelfHeight, surface->h);
+		width = __max(width, x);
+	}
+	*atlasWidth = width;
+	*atlasHeight = y + shelfHeight;
+	return true;
+}
+
+// write the sprites and their manifest in the format described at SPRITE_ATLAS_FILE
+// returns true when successful
+bool WriteSpriteAtlas(const char* filename, SDL_Surface* atlas, PackedSprite* sprites, int count)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		printf("Couldn't open %s for writing the sprite atlas\n", filename);
+		return false;
+	}
+
+	int manifestEnd = SPRITE_ATLAS_HEADER_SIZE + count * SPRITE_ATLAS_ENTRY_SIZE;
+	int pixelOffset = (manifestEnd + SPRITE_ATLAS_PIXEL_ALIGNMENT - 1) / SPRITE_ATLAS_PIXEL_ALIGNMENT * SPRITE_ATLAS_PIXEL_ALIGNMENT;
+
+	fwrite(SPRITE_ATLAS_MAGIC, 1, 4, file);
+	WriteLE(file, SPRITE_ATLAS_VERSION, 4);
+	WriteLE(file, atlas->w, 4);
+	WriteLE(file, atlas->h, 4);
+	WriteLE(file, count, 4);
+	WriteLE(file, pixelOffset, 4);
+	for (int i = 0; i < count; i++)
+	{
+		fwrite(sprites[i].name, 1, SPRITE_ATLAS_NAME_LENGTH, file);
+		WriteLE(file, sprites[i].rect.x, 4);
+		WriteLE(file, sprites[i].rect.y, 4);
+		WriteLE(file, sprites[i].rect.w, 4);
+		WriteLE(file, sprites[i].rect.h, 4);
+		WriteLE(file, sprites[i].flags, 4);
+	}
+	for (int i = manifestEnd; i < pixelOffset; i++)
+		fputc(0, file);
+	for (int y = 0; y < atlas->h; y++)
+		fwrite((Uint8*)atlas->pixels + y * atlas->pitch, 4, atlas->w, file);
+
+	bool success = !ferror(file);
+	fclose(file);
+	if (!success)
+		printf("Error while writing the sprite atlas to %s\n", filename);
+	return success;
+}
+
+// pack bitmaps into one sprite atlas archive, which the game maps at startup instead of loading every bitmap
+// returns true when successful
+bool PackSpriteAtlas(const char* filename, const char** files, int fileCount)
+{
+	PackedSprite* sprites = (PackedSprite*)CountedCalloc(fileCount, sizeof(PackedSprite));
+	if (sprites == NULL)
+	{
+		printf("Ran out of memory while packing the sprites\n");
+		return false;
+	}
+
+	bool success = true;
+	for (int i = 0; i < fileCount && success; i++)
+	{
+		SDL_Surface* loaded = NULL;
+		success = LoadBitmap(&loaded, files[i]);
+		if (!success)
+			break;
+
+		// the atlas is stored in the format of the screen
+		sprites[i].surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+		SDL_FreeSurface(loaded);
+		if (sprites[i].surface == NULL)
+		{
+			printf("SDL_ConvertSurfaceFormat error: %s\n", SDL_GetError());
+			success = false;
+			break;
+		}
+		GetSpriteName(files[i], sprites[i].name);
+		sprites[i].flags = GetSpriteFlags(sprites[i].surface);
+
+		for (int j = 0; j < i; j++)
+		{
+			if (strcmp(sprites[i].name, sprites[j].name) == 0)
+			{
+				printf("%s has the same sprite name as %s\n", files[i], files[j]);
+				success = false;
+			}
+		}
+	}
+
+	int width = 0;
+	int height = 0;
+	if (success)
+		success = PlaceSprites(sprites, fileCount, &width, &height);
+
+	SDL_Surface* atlas = NULL;
+	if (success)
+	{
+		atlas = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+		if (atlas == NULL)
+		{
+			printf("SDL_CreateRGBSurfaceWithFormat error: %s\n", SDL_GetError());
+			success = false;
+		}
+	}
+	for (int i = 0; i < fileCount && success; i++)
+	{
+		// copy the pixels as they are, alpha included
+		SDL_SetSurfaceBlendMode(sprites[i].surface, SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(sprites[i].surface, NULL, atlas, &sprites[i].rect);
+	}
+
+	if (success)
+		success = WriteSpriteAtlas(filename, atlas, sprites, fileCount);
+	if (success)
+		printf("Packed %d sprites into a %dx%d atlas in %s\n", fileCount, width, height, filename);
+
+	SDL_FreeSurface(atlas);
+	for (int i = 0; i < fileCount; i++)
+		SDL_FreeSurface(sprites[i].surface);
+	free(sprites);
+	return success;
+}
+
+// has to be called before the renderer is destroyed
+void FreeBitmaps(SpriteAtlas* atlas, SDL_Surface** bmps)
+{
+	for (int i = 0; i < BMP_COUNT; i++)
+	{
+		if (bmps[i] == NULL)
+			continue;
+		SpriteTexture* spriteTexture = (SpriteTexture*)bmps[i]->userdata;
+		if (spriteTexture != NULL && spriteTexture->texture != atlas->texture)
+			SDL_DestroyTexture(spriteTexture->texture);
+		free(spriteTexture);
+		SDL_FreeSurface(bmps[i]);
+		bmps[i] = NULL;
+	}
+	if (atlas->texture != NULL)
+		SDL_DestroyTexture(atlas->texture);
+	SDL_FreeSurface(atlas->surface);
+	UnmapFile(&atlas->file);
+	*atlas = SpriteAtlas();
+}
+
+// map the sprite atlas and make every sprite a view of its rectangle in the atlas
+// returns false when the archive is missing or damaged, the sprites have to be loaded from bitmaps then
+bool LoadSpriteAtlas(SpriteAtlas* atlas, SDL_Surface** bmps, const char* filename)
+{
+	// copy-on-write, so the sprites can still be changed after loading (see MakeOpaque)
+	if (!MapFile(&atlas->file, filename, true))
+		return false;
+
+	const Uint8* data = atlas->file.data;
+	Sint64 size = atlas->file.size;
+	if (size < SPRITE_ATLAS_HEADER_SIZE || memcmp(data, SPRITE_ATLAS_MAGIC, 4) != 0 ||
+		SDL_SwapLE32(*(const Uint32*)(data + 4)) != SPRITE_ATLAS_VERSION)
+	{
+		printf("%s is not a valid sprite atlas\n", filename);
+		FreeBitmaps(atlas, bmps);
+		return false;
+	}
+
+	Uint32 width = SDL_SwapLE32(*(const Uint32*)(data + 8));
+	Uint32 height = SDL_SwapLE32(*(const Uint32*)(data + 12));
+	Uint32 count = SDL_SwapLE32(*(const Uint32*)(data + 16));
+	Uint32 pixelOffset = SDL_SwapLE32(*(const Uint32*)(data + 20));
+	if (width == 0 || width > SPRITE_ATLAS_WIDTH || height == 0 || pixelOffset % SPRITE_ATLAS_PIXEL_ALIGNMENT != 0 ||
+		pixelOffset < SPRITE_ATLAS_HEADER_SIZE + (Sint64)count * SPRITE_ATLAS_ENTRY_SIZE ||
+		size < pixelOffset + (Sint64)width * height * 4)
+	{
+		printf("%s is damaged\n", filename);
+		FreeBitmaps(atlas, bmps);
+		return false;
+	}
+
+	Uint8* pixels = (Uint8*)data + pixelOffset;
+	int pitch = width * 4;
+	atlas->surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels, width, height, 32, pitch, SDL_PIXELFORMAT_ARGB8888);
+	bool success = atlas->surface != NULL;
+	if (!success)
+		printf("SDL_CreateRGBSurfaceWithFormatFrom error: %s\n", SDL_GetError());
+	for (int i = 0; i < BMP_COUNT && success; i++)
+	{
+		const Uint8* entry = NULL;
+		for (Uint32 j = 0; j < count && entry == NULL; j++)
+		{
+			const Uint8* candidate = data + SPRITE_ATLAS_HEADER_SIZE + j * SPRITE_ATLAS_ENTRY_SIZE;
+			if (strncmp((const char*)candidate, BITMAP_NAMES[i], SPRITE_ATLAS_NAME_LENGTH) == 0)
+				entry = candidate;
+		}
+		if (entry == NULL)
+		{
+			printf("%s doesn't contain the sprite %s\n", filename, BITMAP_NAMES[i]);
+			success = false;
+			break;
+		}
+
+		const Uint32* fields = (const Uint32*)(entry + SPRITE_ATLAS_NAME_LENGTH);
+		Uint32 x = SDL_SwapLE32(fields[0]);
+		Uint32 y = SDL_SwapLE32(fields[1]);
+		Uint32 w = SDL_SwapLE32(fields[2]);
+		Uint32 h = SDL_SwapLE32(fields[3]);
+		Uint32 flags = SDL_SwapLE32(fields[4]);
+		if (w == 0 || h == 0 || x >= width || y >= height || w > width - x || h > height - y)
+		{
+			printf("%s is damaged\n", filename);
+			success = false;
+			break;
+		}
+
+		atlas->rects[i] = { (int)x, (int)y, (int)w, (int)h };
+		bmps[i] = SDL_CreateRGBSurfaceWithFormatFrom(pixels + y * pitch + x * 4, w, h, 32, pitch, SDL_PIXELFORMAT_ARGB8888);
+		if (bmps[i] == NULL)
+		{
+			printf("SDL_CreateRGBSurfaceWithFormatFrom error: %s\n", SDL_GetError());
+			success = false;
+			break;
+		}
+		// surfaces with an alpha channel are blended by default
+		if (!(flags & SPRITE_TRANSLUCENT))
+			SDL_SetSurfaceBlendMode(bmps[i], SDL_BLENDMODE_NONE);
+	}
+
+	if (!success)
+	{
+		FreeBitmaps(atlas, bmps);
+		return false;
+	}
+	printf("Sprite atlas %s mapped (%dx%d, %d sprites)\n", filename, (int)width, (int)height, (int)count);
+	return true;
+}
+
+// transparent pixels of a 32 bit sprite are filled with opaque ones from further along the same row
+// copying from a distance keeps the texture's noise, the nearest neighbour would smear into stripes
+void MakeOpaque(SDL_Surface* sprite)
+{
+	SDL_PixelFormat* format = sprite->format;
+	if (format->BytesPerPixel != 4 || format->Amask == 0)
+		return;
+
+	SDL_LockSurface(sprite);
+	for (int y = 0; y < sprite->h; y++)
+	{
+		Uint32* row = (Uint32*)((Uint8*)sprite->pixels + y * sprite->pitch);
+		for (int x = 0; x < sprite->w; x++)
+		{
+			if ((row[x] & format->Amask) == format->Amask)
+				continue;
+
+			// the row wraps around
+			for (int i = OPAQUE_FILL_DISTANCE; i < sprite->w + OPAQUE_FILL_DISTANCE; i++)
+			{
+				Uint32 pixel = row[(x + i) % sprite->w];
+				if ((pixel & format->Amask) == format->Amask)
+				{
+					row[x] = pixel;
+					break;
+				}
+			}
+		}
+	}
+	SDL_UnlockSurface(sprite);
+}
+
+// load all sprites, from the atlas when there is one
+// returns true when successful
+bool LoadAllBitmaps(SpriteAtlas* atlas, SDL_Surface** bmps)
+{
+	*atlas = SpriteAtlas();
+	for (int i = 0; i < BMP_COUNT; i++)
+		bmps[i] = NULL;
+
+	if (!LoadSpriteAtlas(atlas, bmps, SPRITE_ATLAS_FILE))
+	{
+		printf("Couldn't use the sprite atlas %s, loading the bitmaps from ./sprites\n", SPRITE_ATLAS_FILE);
+
+		bool error = false;
+		for (int i = 0; i < BMP_COUNT; i++)
+		{
+			char filename[STRING_BUFFER_SIZE];
+			snprintf(filename, sizeof(filename), "./sprites/%s.bmp", BITMAP_NAMES[i]);
+			error |= !LoadBitmap(&bmps[i], filename);
+		}
+		if (error)
+			return false;
+	}
+
+	SDL_SetColorKey(bmps[BMP_CHARSET], true, 0x000000);
+
+	// the road textures are copied without blending
+	MakeOpaque(bmps[BMP_ROAD_EDGE]);
+	SDL_SetSurfaceBlendMode(bmps[BMP_ROAD_EDGE], SDL_BLENDMODE_NONE);
+	SDL_SetSurfaceBlendMode(bmps[BMP_BACKGROUND], SDL_BLENDMODE_NONE);
+	return true;
+}
+
+// the colour key only works for surface blits, so the sprite is uploaded again with its key turned into alpha
+// returns true when successful
+bool UploadColorKeyedSprite(SpriteTexture* spriteTexture, SDL_Surface* sprite)
+{
+	Uint32 key = 0;
+	SDL_GetColorKey(sprite, &key);
+	Uint32 colorMask = ~sprite->format->Amask;
+
+	Uint32* pixels = (Uint32*)CountedMalloc((size_t)sprite->w * sprite->h * sizeof(Uint32));
+	if (pixels == NULL)
+	{
+		printf("Ran out of memory while uploading a sprite\n");
+		return false;
+	}
+	for (int y = 0; y < sprite->h; y++)
+	{
+		Uint32* row = (Uint32*)((Uint8*)sprite->pixels + y * sprite->pitch);
+		for (int x = 0; x < sprite->w; x++)
+			pixels[y * sprite->w + x] = (row[x] & colorMask) == (key & colorMask) ? 0 : row[x];
+	}
+
+	bool success = SDL_UpdateTexture(spriteTexture->texture, &spriteTexture->rect, pixels, sprite->w * sizeof(Uint32)) == 0;
+	if (!success)
+		printf("SDL_UpdateTexture error: %s\n", SDL_GetError());
+	free(pixels);
+	return success;
+}
+
+// upload the sprites to textures once, so RENDER_TEXTURE can draw them with SDL_RenderCopy
+// the atlas becomes a single texture, separately loaded bitmaps get a texture each
+// every sprite keeps its SpriteTexture in the userdata of its surface
+// returns true when successful
+bool CreateBitmapTextures(SDL_Renderer* renderer, SpriteAtlas* atlas, SDL_Surface** bmps)
+{
+	if (atlas->surface != NULL)
+	{
+		atlas->texture = SDL_CreateTextureFromSurface(renderer, atlas->surface);
+		if (atlas->texture == NULL)
+		{
+			printf("SDL_CreateTextureFromSurface error: %s\n", SDL_GetError());
+			return false;
+		}
+	}
+
+	for (int i = 0; i < BMP_COUNT; i++)
+	{
+		SpriteTexture* spriteTexture = (SpriteTexture*)CountedMalloc(sizeof(SpriteTexture));
+		if (spriteTexture == NULL)
+		{
+			printf("Ran out of memory while creating the sprite textures\n");
+			return false;
+		}
+		bmps[i]->userdata = spriteTexture;
+
+		if (atlas->texture != NULL)
+		{
+			spriteTexture->texture = atlas->texture;
+			spriteTexture->rect = atlas->rects[i];
+			if (SDL_HasColorKey(bmps[i]) && !UploadColorKeyedSprite(spriteTexture, bmps[i]))
+				return false;
+		}
+		else
+		{
+			spriteTexture->texture = SDL_CreateTextureFromSurface(renderer, bmps[i]);
+			spriteTexture->rect = { 0, 0, bmps[i]->w, bmps[i]->h };
+			if (spriteTexture->texture == NULL)
+			{
+				printf("SDL_CreateTextureFromSurface error: %s\n", SDL_GetError());
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// average time of blitting the whole sprite onto the screen, in microseconds
+double MeasureBlitCost(SDL_Surface* sprite, SDL_Surface* screen)
+{
+	// the first blit maps the formats (and RLE encodes the sprite), it isn't timed
+	SDL_Rect dest = { 0, 0, 0, 0 };
+	SDL_BlitSurface(sprite, NULL, screen, &dest);
+
+	int rangeX = __max(screen->w - sprite->w, 1);
+	int rangeY = __max(screen->h - sprite->h, 1);
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < BLIT_REPORT_REPEATS; i++)
+	{
+		dest = { i * 37 % rangeX, i * 23 % rangeY, 0, 0 };
+		SDL_BlitSurface(sprite, NULL, screen, &dest);
+	}
+	Uint64 end = SDL_GetPerformanceCounter();
+	return (double)(end - start) * 1000000.0 / SDL_GetPerformanceFrequency() / BLIT_REPORT_REPEATS;
+}
+
+// get the sprites ready for RENDER_SURFACE:
+// every sprite is converted to the screen's pixel format, so blits don't have to convert pixels,
+// and sprites with transparent pixels are RLE encoded, so blits skip the transparent runs
+// with report, the blit cost of every sprite before and after is printed
+// returns true when successful
+bool PrepareBitmaps(SDL_Surface** bmps, SDL_Surface* screen, bool report)
+{
+	double before[BMP_COUNT] = {};
+	if (report)
+	{
+		for (int i = 0; i < BMP_COUNT; i++)
+			before[i] = MeasureBlitCost(bmps[i], screen);
+	}
+
+	for (int i = 0; i < BMP_COUNT; i++)
+	{
+		SDL_BlendMode blendMode = SDL_BLENDMODE_NONE;
+		SDL_GetSurfaceBlendMode(bmps[i], &blendMode);
+
+		if (bmps[i]->format->format != screen->format->format)
+		{
+			// the colour key is converted too, the blend mode has to be restored
+			SDL_Surface* converted = SDL_ConvertSurface(bmps[i], screen->format, 0);
+			if (converted == NULL)
+			{
+				printf("SDL_ConvertSurface error: %s\n", SDL_GetError());
+				return false;
+			}
+			SDL_SetSurfaceBlendMode(converted, blendMode);
+			SDL_FreeSurface(bmps[i]);
+			bmps[i] = converted;
+		}
+
+		// opaque sprites stay unencoded, DrawSpan copies their rows directly
+		if (blendMode != SDL_BLENDMODE_NONE || SDL_HasColorKey(bmps[i]))
+			SDL_SetSurfaceRLE(bmps[i], 1);
+	}
+
+	if (report)
+	{
+		printf("Blit cost of every sprite (microseconds per blit, %d blits):\n", BLIT_REPORT_REPEATS);
+		printf("%-14s %9s %9s %9s\n", "sprite", "size", "before", "after");
+		for (int i = 0; i < BMP_COUNT; i++)
+		{
+			char size[STRING_BUFFER_SIZE];
+			snprintf(size, sizeof(size), "%dx%d", bmps[i]->w, bmps[i]->h);
+			printf("%-14s %9s %9.2f %9.2f\n", BITMAP_NAMES[i], size, before[i], MeasureBlitCost(bmps[i], screen));
+		}
+		// the measurements drew over the screen
+		SDL_FillRect(screen, NULL, 0);
+	}
+	return true;
+}
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// GAME OBJECTS
+
+struct GameData;
+
+class GameObject
+{
+public:
+	bool visible = true;
+	Vector2 position = {};
+	Vector2 previousPosition = {}; // position from the previous tick, used for interpolation
+	Vector2 size = {};
+	SDL_Surface* sprite = NULL;
+
+	// moves the object without interpolating from its old position
+	void SetPosition(Vector2 pos)
+	{
+		position = pos;
+		previousPosition = pos;
+	}
+	
+	// alpha is the interpolation factor between the previous and current position
+	virtual void Draw(Canvas* canvas, double alpha)
+	{
+		if (!visible) return;
+
+		if (sprite == NULL)
+		{
+			printf("Error while drawing GameObject: sprite is NULL\n");
+			return;
+		}
+
+		Vector2 pos = Lerp(previousPosition, position, alpha);
+		DrawSurface(canvas, sprite, pos.x, pos.y);
+	}
+};
+
+class Car : public GameObject
+{
+public:
+	Vector2 speed = {};
+
+	SDL_Surface* explosion0 = NULL;
+	SDL_Surface* explosion1 = NULL;
+
+	double deathTime = 0;
+	bool IsDead()
+	{
+		return deathTime > 0;
+	}
+
+	// returns true if the animation has ended & the car can be deleted
+	bool AnimateDeath(Time time)
+	{
+		if (deathTime > 0)
+		{
+			if (time.gametime >= deathTime + DEATH_ANIM_DURATION)
+				return true; 
+			else if (time.gametime >= deathTime + DEATH_ANIM_DURATION / 2)
+				sprite = explosion1;
+			else if (time.gametime >= deathTime)
+				sprite = explosion0;
+		}
+
+		return false;
+	}
+};
+
+class Player : public Car
+{
+public:
+	double distanceCounter = 0;
+	double previousDistanceCounter = 0; // used for interpolation, like previousPosition
+	double scoringDistanceCounter = 0;
+	double nextShootTime = 0;
+	double scorePenalty = 0;
+	int score = 0;
+	int lifeScoreCounter = 0;
+	int lives = 0;
+	int rifleAmmo = 0;
+};
+
+// data shared by all NPCs of the same type
+struct NPCArchetype
+{
+	SDL_Surface* sprite = NULL;
+	SDL_Surface* explosion0 = NULL;
+	SDL_Surface* explosion1 = NULL;
+	Vector2 size = {};
+	Vector2 startSpeed = {};
+	int health = 0;
+};
+
+// an NPC in the collision broadphase, sorted by the top edge of the car
+struct SweepEntry
+{
+	double top;
+	double bottom;
+	int index;
+};
+
+// NPCs are stored as a structure of arrays
+// all arrays have the same capacity, NPC number i is made of the i-th element of each array
+struct NPCStore
+{
+	int count = 0;
+	int capacity = 0;
+
+	Vector2* position = NULL;
+	Vector2* previousPosition = NULL;
+	Vector2* speed = NULL;
+	int* health = NULL;
+	NPCType* type = NULL;
+	double* deathTime = NULL;
+
+	// scratch space for the collision broadphase, it isn't part of the NPC state
+	SweepEntry* sweep = NULL;
+};
+
+// pointers to the state of a single car
+// collisions use this, so they work the same way for the player and for NPCs
+struct CarRef
+{
+	Vector2* position;
+	Vector2* speed;
+	Vector2 size;
+	double* deathTime;
+};
+
+// bullets in flight, stored as a structure of arrays like the NPCs
+// the arrays are packed, so the unused end of them is the pool that new bullets are taken from
+struct BulletStore
+{
+	int count = 0;
+	int capacity = 0;
+
+	Vector2* position = NULL;
+	Vector2* previousPosition = NULL;
+	Vector2* speed = NULL;
+};
+
+// left and right edge of the road at some distance
+struct RoadEdges
+{
+	double left;
+	double right;
+};
+
+// cached samples of the road edges
+// sample number i describes the road at distance i * ROAD_PROFILE_STEP
+// and is stored in the slot i modulo ROAD_PROFILE_SAMPLES
+struct RoadProfile
+{
+	double left[ROAD_PROFILE_SAMPLES] = {};
+	double right[ROAD_PROFILE_SAMPLES] = {};
+	long long firstSample = 0;
+	int sampleCount = 0;
+};
+
+struct GameData
+{
+	double gameOverTime = 0;
+
+	// game objects
+	Player* player = NULL;
+	NPCStore npcs;
+	NPCArchetype npcArchetypes[NPC_TYPE_COUNT];
+	BulletStore bullets;
+	SDL_Surface* bulletSprite = NULL;
+	GameObject* riflePowerup = NULL;
+
+	GameObject* background = NULL; 
+	SDL_Surface* grassSprite = NULL; // drawn next to the road, see DrawRoad
+	RoadProfile road;
+
+	// NPC spawning
+	double nextObjectSpawnTick = 0;
+
+	Uint64 seed = 0;
+	Random random[RNG_STREAM_COUNT] = {};
+
+	// every object and array above is allocated from here
+	Arena* arena = NULL;
+};
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// MEMORY MANAGEMENT
+
+// everything the game allocated is in its arena
+void FreeGameMemory(GameData* gameData)
+{
+	ResetArena(gameData->arena);
+	*gameData = GameData();
+}
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// ROAD SHAPE GENERATION
+
+// returns a pseudo random value between -1 and 1
+double PseudoNoise(double x)
+{
+	return (sin(x * M_PI) + sin(x * 2)) * 0.5 * sin(x);
+}
+
+double GetRoadCenter(double distance)
+{
+	return PseudoNoise(distance * ROAD_BEND_FREQUENCY) * ROAD_CENTER_VARIATION;
+}
+double GetRoadWidth(double distance)
+{
+	return ROAD_MIN_WIDTH + (PseudoNoise(distance * ROAD_WIDTH_FREQUENCY) + 1) / 2 * (ROAD_MAX_WIDTH - ROAD_MIN_WIDTH);
+}
+
+double GetRoadEdgeLeft(double distance)
+{
+	return SCREEN_WIDTH / 2 + GetRoadCenter(distance) - GetRoadWidth(distance) * 0.5;
+}
+double GetRoadEdgeRight(double distance)
+{
+	return SCREEN_WIDTH / 2 + GetRoadCenter(distance) + GetRoadWidth(distance) * 0.5;
+}
+
+int GetRoadProfileSlot(long long sample)
+{
+	int slot = (int)(sample % ROAD_PROFILE_SAMPLES);
+	return slot < 0 ? slot + ROAD_PROFILE_SAMPLES : slot;
+}
+
+// moves the cached part of the road so it's centered on the given distance
+// only the samples that weren't cached yet are calculated
+void UpdateRoadProfile(RoadProfile* road, double distance)
+{
+	long long first = (long long)floor(distance / ROAD_PROFILE_STEP) - ROAD_PROFILE_SAMPLES / 2;
+	long long end = first + ROAD_PROFILE_SAMPLES;
+	long long cachedEnd = road->firstSample + road->sampleCount;
+
+	// when the new range doesn't start inside the cached one, everything is recalculated
+	long long start = first;
+	if (first >= road->firstSample && first < cachedEnd)
+		start = cachedEnd;
+
+	for (long long i = start; i < end; i++)
+	{
+		int slot = GetRoadProfileSlot(i);
+		road->left[slot] = GetRoadEdgeLeft(i * ROAD_PROFILE_STEP);
+		road->right[slot] = GetRoadEdgeRight(i * ROAD_PROFILE_STEP);
+	}
+
+	road->firstSample = first;
+	road->sampleCount = ROAD_PROFILE_SAMPLES;
+}
+
+// returns the road edges, interpolated between the two closest cached samples
+// distances outside of the cache are calculated directly
+RoadEdges GetRoadEdges(RoadProfile* road, double distance)
+{
+	double position = distance / ROAD_PROFILE_STEP;
+	long long sample = (long long)floor(position);
+	if (sample < road->firstSample || sample + 1 >= road->firstSample + road->sampleCount)
+		return { GetRoadEdgeLeft(distance), GetRoadEdgeRight(distance) };
+
+	int a = GetRoadProfileSlot(sample);
+	int b = GetRoadProfileSlot(sample + 1);
+	double t = position - sample;
+	return { road->left[a] + (road->left[b] - road->left[a]) * t,
+		road->right[a] + (road->right[b] - road->right[a]) * t };
+}
+
+bool IsOnRoad(RoadProfile* road, Vector2 pos, double distance)
+{
+	RoadEdges edges = GetRoadEdges(road, distance - pos.y);
+	if (edges.left > pos.x || edges.right < pos.x)
+	{
+		return false;
+	}
+	return true;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// GAME MECHANICS
+
+
+// grow every array of the store to the new capacity
+// returns true when successful
+bool ReserveNPCs(Arena* arena, NPCStore* npcs, int capacity)
+{
+	if (capacity <= npcs->capacity)
+		return true;
+
+	int count = npcs->count;
+	Vector2* position = (Vector2*)GrowArenaArray(arena, npcs->position, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (position != NULL) npcs->position = position;
+	Vector2* previousPosition = (Vector2*)GrowArenaArray(arena, npcs->previousPosition, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (previousPosition != NULL) npcs->previousPosition = previousPosition;
+	Vector2* speed = (Vector2*)GrowArenaArray(arena, npcs->speed, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (speed != NULL) npcs->speed = speed;
+	int* health = (int*)GrowArenaArray(arena, npcs->health, sizeof(int) * count, sizeof(int) * capacity);
+	if (health != NULL) npcs->health = health;
+	NPCType* type = (NPCType*)GrowArenaArray(arena, npcs->type, sizeof(NPCType) * count, sizeof(NPCType) * capacity);
+	if (type != NULL) npcs->type = type;
+	double* deathTime = (double*)GrowArenaArray(arena, npcs->deathTime, sizeof(double) * count, sizeof(double) * capacity);
+	if (deathTime != NULL) npcs->deathTime = deathTime;
+	// the sweep is rebuilt before every use, so it isn't copied
+	SweepEntry* sweep = (SweepEntry*)ArenaAlloc(arena, sizeof(SweepEntry) * capacity);
+	if (sweep != NULL) npcs->sweep = sweep;
+
+	// the capacity only changes when all arrays were resized
+	if (position == NULL || previousPosition == NULL || speed == NULL ||
+		health == NULL || type == NULL || deathTime == NULL || sweep == NULL)
+	{
+		printf("Ran out of memory when adding NPCs!\n");
+		return false;
+	}
+
+	npcs->capacity = capacity;
+	return true;
+}
+
+CarRef GetPlayerRef(Player* player)
+{
+	return { &player->position, &player->speed, player->size, &player->deathTime };
+}
+CarRef GetNPCRef(GameData* gameData, int npcIndex)
+{
+	NPCStore* npcs = &gameData->npcs;
+	return { &npcs->position[npcIndex], &npcs->speed[npcIndex],
+		gameData->npcArchetypes[npcs->type[npcIndex]].size, &npcs->deathTime[npcIndex] };
+}
+
+// returns false when there's no memory for the NPC
+bool CreateNPC(GameData* gameData, Vector2 pos, NPCType type)
+{
+	NPCStore* npcs = &gameData->npcs;
+	if (npcs->count >= npcs->capacity &&
+		!ReserveNPCs(gameData->arena, npcs, __max(npcs->capacity * 2, NPC_INITIAL_CAPACITY)))
+	{
+		printf("Couldn't create a new npc\n");
+		return false;
+	}
+
+	NPCArchetype* archetype = &gameData->npcArchetypes[type];
+	int i = npcs->count;
+	npcs->position[i] = pos;
+	npcs->previousPosition[i] = pos;
+	npcs->speed[i] = archetype->startSpeed;
+	npcs->health[i] = archetype->health;
+	npcs->type[i] = type;
+	npcs->deathTime[i] = 0;
+	npcs->count++;
+	return true;
+}
+void DeleteNPC(GameData* gameData, int npcIndex)
+{
+	// if the deleted npc isn't the last one in the array
+	// move the last one into it's place
+	// like this:
+	// ##D##L
+	//     / 
+	//    /  
+	// ##L## 
+
+	NPCStore* npcs = &gameData->npcs;
+	npcs->count--;
+	int last = npcs->count;
+	if (npcIndex != last)
+	{
+		npcs->position[npcIndex] = npcs->position[last];
+		npcs->previousPosition[npcIndex] = npcs->previousPosition[last];
+		npcs->speed[npcIndex] = npcs->speed[last];
+		npcs->health[npcIndex] = npcs->health[last];
+		npcs->type[npcIndex] = npcs->type[last];
+		npcs->deathTime[npcIndex] = npcs->deathTime[last];
+	}
+}
+
+bool IsDead(double deathTime)
+{
+	return deathTime > 0;
+}
+void KillCar(double* deathTime, Time time)
+{
+	if (!IsDead(*deathTime))
+	{
+		*deathTime = time.gametime;
+	}
+}
+void DamageNPC(int damage, GameData* gameData, int npcIndex, Time time)
+{
+	gameData->npcs.health[npcIndex] -= damage;
+	if (gameData->npcs.health[npcIndex] <= 0)
+	{
+		KillCar(&gameData->npcs.deathTime[npcIndex], time);
+	}
+}
+
+// returns true if the death animation has ended & the car can be deleted
+bool DeathAnimationEnded(double deathTime, Time time)
+{
+	return IsDead(deathTime) && time.gametime >= deathTime + DEATH_ANIM_DURATION;
+}
+
+// picks the sprite of a car, based on how far its death animation is
+SDL_Surface* GetNPCSprite(NPCArchetype* archetype, double deathTime, double gametime)
+{
+	if (IsDead(deathTime))
+	{
+		if (gametime >= deathTime + DEATH_ANIM_DURATION / 2)
+			return archetype->explosion1;
+		if (gametime >= deathTime)
+			return archetype->explosion0;
+	}
+	return archetype->sprite;
+}
+
+double CalculateMaxSideSpeed(double forwardSpeed, double maxForwardSpeed, double maxSideSpeed)
+{
+	return (forwardSpeed / maxForwardSpeed) * maxSideSpeed;
+}
+
+void PlayerSteering(Player* player, Time time, Input* input)
+{
+	// convert input into a direction vector
+	Vector2 steering = { 0,0 };
+	if (input->up) steering.y--;
+	if (input->down) steering.y++;
+	if (input->left) steering.x--;
+	if (input->right) steering.x++;
+
+	// accelerate / decelerate and steer the car
+	if (steering.x == 0)
+		MoveTowards(&player->speed.x, 0, time.delta * PLAYER_IDLE_ACCEL_SIDES);
+	else
+		MoveTowards(&player->speed.x, 
+			steering.x * CalculateMaxSideSpeed(-player->speed.y, PLAYER_MAX_SPEED, PLAYER_MAX_SPEED_SIDES),
+			time.delta * PLAYER_ACCEL_SIDES);
+
+	player->speed.y += steering.y * time.delta * PLAYER_ACCEL;
+	player->speed.y = Clamp(player->speed.y, -PLAYER_MAX_SPEED, -PLAYER_MIN_SPEED);
+
+	// the player doesn't move along the y axis, the rest of the world does
+	player->position.x += player->speed.x * time.delta;
+	MoveTowards(&player->position.y, PLAYER_Y_POS, time.delta * PLAYER_START_SPEED);
+	player->distanceCounter -= player->speed.y * time.delta;
+}
+
+bool ReserveBullets(Arena* arena, BulletStore* bullets, int capacity)
+{
+	if (capacity <= bullets->capacity)
+		return true;
+
+	int count = bullets->count;
+	Vector2* position = (Vector2*)GrowArenaArray(arena, bullets->position, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (position != NULL) bullets->position = position;
+	Vector2* previousPosition = (Vector2*)GrowArenaArray(arena, bullets->previousPosition, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (previousPosition != NULL) bullets->previousPosition = previousPosition;
+	Vector2* speed = (Vector2*)GrowArenaArray(arena, bullets->speed, sizeof(Vector2) * count, sizeof(Vector2) * capacity);
+	if (speed != NULL) bullets->speed = speed;
+
+	// the capacity only changes when all arrays were resized
+	if (position == NULL || previousPosition == NULL || speed == NULL)
+	{
+		printf("Ran out of memory when adding bullets!\n");
+		return false;
+	}
+
+	bullets->capacity = capacity;
+	return true;
+}
+
+void PlayerShoot(Arena* arena, BulletStore* bullets, Vector2 pos, Vector2 speed)
+{
+	if (bullets->count >= bullets->capacity &&
+		!ReserveBullets(arena, bullets, __max(bullets->capacity * 2, BULLET_INITIAL_CAPACITY)))
+		return;
+
+	int i = bullets->count;
+	bullets->position[i] = pos;
+	bullets->previousPosition[i] = pos;
+	bullets->speed[i] = speed;
+	bullets->count++;
+}
+
+// the last bullet is moved into the place of the deleted one, same as with NPCs
+void DeleteBullet(BulletStore* bullets, int bulletIndex)
+{
+	bullets->count--;
+	int last = bullets->count;
+	if (bulletIndex != last)
+	{
+		bullets->position[bulletIndex] = bullets->position[last];
+		bullets->previousPosition[bulletIndex] = bullets->previousPosition[last];
+		bullets->speed[bulletIndex] = bullets->speed[last];
+	}
+}
+void PlayerShooting(GameData* gameData, Time time, Input* input)
+{
+	if (input->shoot && gameData->player->nextShootTime <= time.gametime)
+	{
+		Vector2 speed = { 0, -BULLET_SPEED };
+		if (gameData->player->rifleAmmo > 0)
+		{
+			gameData->player->nextShootTime = time.gametime + PLAYER_FIRE_INTERVAL / 2;
+			speed.y *= 2;
+		}
+		else
+			gameData->player->nextShootTime = time.gametime + PLAYER_FIRE_INTERVAL;
+
+		PlayerShoot(gameData->arena, &gameData->bullets, gameData->player->position, speed);
+
+		gameData->player->rifleAmmo--;
+	}
+}
+
+void AddScore(int points, Player* player, Time time)
+{
+	if (player->scorePenalty <= time.gametime && !player->IsDead())
+	{
+		player->score += points;
+
+		player->lifeScoreCounter += points;
+		if (player->lifeScoreCounter >= POINTS_PER_LIFE)
+		{
+			player->lives++;
+			player->lifeScoreCounter -= POINTS_PER_LIFE;
+		}
+	}
+}
+void CountScorePerDistance(Player* player, Time time)
+{
+	// count the score based on distance
+	player->scoringDistanceCounter -= player->speed.y * time.delta;
+	if (player->scoringDistanceCounter >= DISTANCE_TO_SCORE)
+	{
+		AddScore(SCORE_PER_DISTANCE, player, time);
+		player->scoringDistanceCounter = 0;
+	}
+}
+
+
+void EnemyAI(Vector2 position, Vector2* speed, Player* player, RoadProfile* road, Time time)
+{
+	if (fabs(position.y - player->position.y) < ENEMY_TARGET_DISTANCE)
+	{
+		// match the players speed
+		MoveTowards(&speed->y, player->speed.y - (position.y - player->position.y), time.delta * ENEMY_ACCEL);
+
+		// try to push the player off the road
+		MoveTowards(&speed->x,
+			Sign(player->position.x - position.x) * CalculateMaxSideSpeed(-speed->y, ENEMY_MAX_SPEED, ENEMY_MAX_SPEED_SIDES),
+			time.delta * ENEMY_ACCEL_SIDES);
+	}
+	else
+	{
+		// avoid road edges
+		if (!IsOnRoad(road, { position.x + NPC_EDGE_DISTANCE, position.y }, player->distanceCounter))
+			MoveTowards(&speed->x, -ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
+		else if (!IsOnRoad(road, { position.x - NPC_EDGE_DISTANCE, position.y }, player->distanceCounter))
+			MoveTowards(&speed->x, ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
+		else
+			MoveTowards(&speed->x, 0, time.delta * ENEMY_ACCEL_SIDES);
+
+		// catch up or wait for the player
+		if (position.y < player->position.y)
+			MoveTowards(&speed->y, player->speed.y + ENEMY_BRAKING, time.delta * ENEMY_ACCEL);
+		else
+			MoveTowards(&speed->y, -ENEMY_MAX_SPEED, time.delta * ENEMY_ACCEL);
+	}
+
+
+	speed->y = Clamp(speed->y, -ENEMY_MAX_SPEED, -ENEMY_MIN_SPEED);
+}
+void CivilianAI(Vector2 position, Vector2* speed, RoadProfile* road, Time time, double distance, Random* random)
+{
+	// avoid road edges
+	if (!IsOnRoad(road, { position.x + NPC_EDGE_DISTANCE, position.y }, distance))
+		MoveTowards(&speed->x, -ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
+	else if (!IsOnRoad(road, { position.x - NPC_EDGE_DISTANCE, position.y }, distance))
+		MoveTowards(&speed->x, ENEMY_MAX_SPEED_SIDES, time.delta * ENEMY_ACCEL_SIDES);
+	// now and then swerve to a random side, the side speed then slows down back to 0
+	else if (RandVal(random) < CIVILIAN_SWERVE_CHANCE * time.delta)
+		speed->x = RandVal(random) < 0.5 ? -CIVILIAN_SWERVE_SPEED : CIVILIAN_SWERVE_SPEED;
+	else
+		MoveTowards(&speed->x, 0, time.delta * ENEMY_ACCEL_SIDES);
+
+	MoveTowards(&speed->y, -CIVILIAN_SPEED, time.delta * CIVILIAN_ACCEL);
+}
+// the AI takes its random decisions from random
+void UpdateNPC(NPCStore* npcs, int npcIndex, Player* player, RoadProfile* road, Time time, Random* random)
+{
+	Vector2* position = &npcs->position[npcIndex];
+	Vector2* speed = &npcs->speed[npcIndex];
+
+	if (!IsDead(npcs->deathTime[npcIndex]))
+	{
+		switch (npcs->type[npcIndex])
+		{
+		case ENEMY:
+			EnemyAI(*position, speed, player, road, time);
+			break;
+		case CIVILIAN:
+			CivilianAI(*position, speed, road, time, player->distanceCounter, random);
+			break;
+		default:
+			break;
+		}
+	}
+	else
+	{
+		MoveTowards(&speed->x, 0, EXPLOSION_FRICTION * time.delta);
+		MoveTowards(&speed->y, 0, EXPLOSION_FRICTION * time.delta);
+	}
+
+	position->x += speed->x * time.delta;
+	position->y += (speed->y - player->speed.y) * time.delta;
+}
+
+
+// the grass next to the road is drawn straight from the road profile, only the asphalt texture moves
+void MoveRoad(GameObject* background, double playerSpeed, Time time)
+{
+	background->position.y -= playerSpeed * time.delta;
+	if (background->position.y > SCREEN_HEIGHT)
+	{
+		background->previousPosition.y -= background->position.y;
+		background->position.y = 0;
+	}
+}
+
+
+
+double GetRandomSpawnPos(Random* random, RoadProfile* road, double distance)
+{
+	RoadEdges edges = GetRoadEdges(road, distance + OBJECT_SPAWN_MARGIN);
+	return RandRange(random, edges.left, edges.right);
+}
+void ObjectSpawning(GameData* gameData, Time time)
+{
+	if (gameData->nextObjectSpawnTick <= time.gametime)
+	{
+		gameData->nextObjectSpawnTick = time.gametime + OBJECT_SPAWN_TICK_INTERVAL;
+
+		Random* spawnRandom = &gameData->random[RNG_SPAWNING];
+		Random* powerupRandom = &gameData->random[RNG_POWERUPS];
+
+		if (RandVal(spawnRandom) < (1.0 / (__max(gameData->npcs.count, 1))))
+		{
+			NPCType type = ENEMY;
+			if (gameData->npcs.count >= 2 && RandVal(spawnRandom) < 0.5)
+			{
+				 type = CIVILIAN;
+			}
+
+			CreateNPC(gameData, { GetRandomSpawnPos(spawnRandom, &gameData->road, gameData->player->distanceCounter), -OBJECT_SPAWN_MARGIN }, type);
+		}
+
+		if (RandVal(powerupRandom) < POWERUP_SPAWN_CHANCE)
+		{
+			if (!gameData->riflePowerup->visible)
+			{
+				gameData->riflePowerup->visible = true;
+				gameData->riflePowerup->SetPosition({ GetRandomSpawnPos(powerupRandom, &gameData->road, gameData->player->distanceCounter), -OBJECT_SPAWN_MARGIN });
+			}
+		}
+	}
+}
+
+
+Vector2 CalculateOverlap(Vector2 pos1, Vector2 size1, Vector2 pos2, Vector2 size2)
+{
+	Vector2 overlap = {};
+	overlap.x = (size1.x + size2.x) * 0.5 - fabs(pos1.x - pos2.x);
+	overlap.y = (size1.y + size2.y) * 0.5 - fabs(pos1.y - pos2.y);
+	return overlap;
+}
+bool IsOverlapping(Vector2 pos1, Vector2 size1, Vector2 pos2, Vector2 size2)
+{
+	Vector2 overlap = CalculateOverlap(pos1, size1, pos2, size2);
+	return overlap.x > 0 && overlap.y > 0;
+}
+bool IsOverlapping(GameObject* go1, GameObject* go2)
+{
+	return IsOverlapping(go1->position, go1->size, go2->position, go2->size);
+}
+
+void CheckCollision(CarRef car1, CarRef car2, Time time)
+{
+	if (IsDead(*car1.deathTime) || IsDead(*car2.deathTime))
+		return;
+
+	Vector2 overlap = CalculateOverlap(*car1.position, car1.size, *car2.position, car2.size);
+	if (overlap.x >= 0 && overlap.y >= 0)
+	{
+		if (fabs(car1.position->x - car2.position->x) >= (car1.size.x + car2.size.x) * 0.25)
+		{
+			// horizontal collision
+			car1.position->x += (overlap.x + 1) * 0.5 * Sign(car1.position->x - car2.position->x);
+			car2.position->x += (overlap.x + 1) * 0.5 * -Sign(car1.position->x - car2.position->x);
+
+			double temp = car1.speed->x * COLLISION_BOUNCE;
+			car1.speed->x = car2.speed->x * COLLISION_BOUNCE;
+			car2.speed->x = temp;
+		}
+		else
+		{
+			// vertical collision
+			car1.position->y += (overlap.y + 1) * 0.5 * Sign(car1.position->y - car2.position->y);
+			car2.position->y += (overlap.y + 1) * 0.5 * -Sign(car1.position->y - car2.position->y);
+
+
+			if (fabs(car1.speed->y - car2.speed->y) >= COLLISION_KILL_SPEED)
+			{
+				if (car1.position->y > car2.position->y)
+					KillCar(car1.deathTime, time);
+				else
+					KillCar(car2.deathTime, time);
+
+			}
+
+			double temp = car1.speed->y * COLLISION_BOUNCE;
+			car1.speed->y = car2.speed->y * COLLISION_BOUNCE;
+			car2.speed->y = temp;
+		}
+	}
+}
+int CompareSweepEntries(const void* a, const void* b)
+{
+	double topA = ((const SweepEntry*)a)->top;
+	double topB = ((const SweepEntry*)b)->top;
+	if (topA < topB) return -1;
+	if (topA > topB) return 1;
+	return ((const SweepEntry*)a)->index - ((const SweepEntry*)b)->index;
+}
+
+// sort the NPCs by the top edge of the car into npcs->sweep
+void SortNPCSweep(GameData* gameData)
+{
+	NPCStore* npcs = &gameData->npcs;
+	for (int i = 0; i < npcs->count; i++)
+	{
+		double halfHeight = gameData->npcArchetypes[npcs->type[i]].size.y * 0.5;
+		npcs->sweep[i] = { npcs->position[i].y - halfHeight, npcs->position[i].y + halfHeight, i };
+	}
+	qsort(npcs->sweep, npcs->count, sizeof(SweepEntry), CompareSweepEntries);
+}
+
+// sweep and prune along the y axis (the road is vertical, so cars are spread out along it)
+// every pair of cars whose bounds overlap is passed to CheckCollision exactly once
+void ResolveCollisions(GameData* gameData, Time time)
+{
+	NPCStore* npcs = &gameData->npcs;
+
+	CarRef player = GetPlayerRef(gameData->player);
+	for (int i = 0; i < npcs->count; i++)
+	{
+		CheckCollision(player, GetNPCRef(gameData, i), time);
+	}
+
+	SortNPCSweep(gameData);
+
+	for (int i = 0; i < npcs->count; i++)
+	{
+		SweepEntry* a = &npcs->sweep[i];
+		for (int j = i + 1; j < npcs->count && npcs->sweep[j].top <= a->bottom; j++)
+		{
+			// the narrowphase checks the x axis
+			CheckCollision(GetNPCRef(gameData, a->index), GetNPCRef(gameData, npcs->sweep[j].index), time);
+		}
+	}
+}
+
+bool IsGameOver(GameData* gameData)
+{
+	return gameData->gameOverTime != 0;
+}
+
+// true when no tick can change what is drawn: the game is paused, or it's over,
+// the player's explosion has ended and every NPC and bullet is gone
+bool SimulationSettled(GameData* gameData, Time time)
+{
+	if (time.paused) return true;
+	return IsGameOver(gameData) && !gameData->player->visible &&
+		gameData->npcs.count == 0 && gameData->bullets.count == 0;
+}
+void GameOver(GameData* gameData, Time time)
+{
+	printf("GAME OVER!\n");
+	gameData->gameOverTime = time.gametime;
+	gameData->player->speed.y = 0;
+}
+
+
+void RespawnPlayer(GameData* gameData, SDL_Surface** bitmaps)
+{
+	if (gameData->player->lives > 0)
+		gameData->player->lives--;
+
+	gameData->player->deathTime = 0;
+	gameData->player->sprite = bitmaps[BMP_PLAYER_CAR];
+	gameData->player->SetPosition({ SCREEN_WIDTH / 2, PLAYER_START_POS });
+	gameData->player->speed = {};
+}
+
+
+void UpdatePlayer(Time time, GameData* gameData, SDL_Surface** bitmaps, Input* input)
+{
+	if (!IsOnRoad(&gameData->road, gameData->player->position, gameData->player->distanceCounter))
+		KillCar(&gameData->player->deathTime, time);
+
+	if (!gameData->player->IsDead())
+	{
+		PlayerSteering(gameData->player, time, input);
+		PlayerShooting(gameData, time, input);
+
+		MoveRoad(gameData->background, gameData->player->speed.y, time);
+
+		CountScorePerDistance(gameData->player, time);
+
+
+	}
+	else
+	{
+		gameData->player->speed.y = 0;
+		if (gameData->player->lives > 0 || time.gametime < INFINITE_LIVES_DURATION)
+		{
+			if (gameData->player->AnimateDeath(time))
+			{
+				RespawnPlayer(gameData, bitmaps);
+			}
+		}
+		else
+		{
+			if (gameData->player->AnimateDeath(time))
+				gameData->player->visible = false;
+
+			if (!IsGameOver(gameData))
+				GameOver(gameData, time);
+		}
+	}
+}
+void UpdateNPCs(Time time, GameData* gameData)
+{
+	NPCStore* npcs = &gameData->npcs;
+	for (int i = 0; i < npcs->count; i++)
+	{
+		UpdateNPC(npcs, i, gameData->player, &gameData->road, time, &gameData->random[RNG_AI]);
+
+		if (!IsOnRoad(&gameData->road, npcs->position[i], gameData->player->distanceCounter))
+			KillCar(&npcs->deathTime[i], time);
+
+		if (DeathAnimationEnded(npcs->deathTime[i], time))
+		{
+			switch (npcs->type[i])
+			{
+			case ENEMY:
+				AddScore(SCORE_PER_ENEMY_KILL, gameData->player, time);
+				break;
+			case CIVILIAN:
+				gameData->player->scorePenalty = time.gametime + SCORE_PENALTY_DURATION;
+				break;
+			default:
+				break;
+			}
+
+			DeleteNPC(gameData, i);
+		}
+		else if (fabs(npcs->position[i].y - SCREEN_HEIGHT / 2) >= OBJECT_DELETE_DISTANCE)
+		{
+			DeleteNPC(gameData, i);
+		}
+	}
+
+}
+// returns the NPC hit by a bullet or -1
+// NPCs are looked up in the sorted sweep, from the first one whose top edge can be below the top of the bullet
+// when the bullet overlaps more than one NPC, the one with the lowest index is hit
+int FindBulletTarget(GameData* gameData, Vector2 position, Vector2 size, double maxNPCHeight)
+{
+	NPCStore* npcs = &gameData->npcs;
+	double bulletTop = position.y - size.y * 0.5;
+	double bulletBottom = position.y + size.y * 0.5;
+
+	int low = 0;
+	int high = npcs->count;
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (npcs->sweep[middle].top <= bulletTop - maxNPCHeight)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	int target = -1;
+	for (int i = low; i < npcs->count && npcs->sweep[i].top < bulletBottom; i++)
+	{
+		int j = npcs->sweep[i].index;
+		if ((target == -1 || j < target) && !IsDead(npcs->deathTime[j]) &&
+			IsOverlapping(position, size, npcs->position[j], gameData->npcArchetypes[npcs->type[j]].size))
+			target = j;
+	}
+	return target;
+}
+
+void UpdateBullets(Time time, GameData* gameData)
+{
+	BulletStore* bullets = &gameData->bullets;
+	if (bullets->count == 0)
+		return;
+
+	// the sweep from the last collision check is out of date, the NPCs have moved since then
+	SortNPCSweep(gameData);
+	double maxNPCHeight = 0;
+	for (int type = 0; type < NPC_TYPE_COUNT; type++)
+		maxNPCHeight = __max(maxNPCHeight, gameData->npcArchetypes[type].size.y);
+
+	Vector2 size = BULLET_SIZE;
+	int i = 0;
+	while (i < bullets->count)
+	{
+		bullets->position[i].x += time.delta * bullets->speed[i].x;
+		bullets->position[i].y += time.delta * bullets->speed[i].y;
+
+		int target = FindBulletTarget(gameData, bullets->position[i], size, maxNPCHeight);
+		if (target >= 0)
+			DamageNPC(1, gameData, target, time);
+
+		// the bullet moved into the deleted one's place is updated next
+		if (target >= 0 || fabs(bullets->position[i].y - gameData->player->position.y) > PLAYER_GUN_RANGE)
+			DeleteBullet(bullets, i);
+		else
+			i++;
+	}
+}
+void UpdatePowerup(Time time, Player* player, GameObject* powerup)
+{
+	if (!powerup->visible) return;
+
+	powerup->position.y -= time.delta * player->speed.y;
+
+	if (!player->IsDead() && IsOverlapping(player, powerup))
+	{
+		player->rifleAmmo = RIFLE_BULLETS_PER_PICKUP;
+		powerup->visible = false;
+	}
+	
+	if (fabs(powerup->position.y - SCREEN_HEIGHT / 2) >= OBJECT_DELETE_DISTANCE)
+	{
+		powerup->visible = false;
+	}
+}
+
+// create all necessary GameObjects
+// games started with the same seed are identical, as long as the input is the same
+// allocate all objects of the game from the arena, it has to be empty
+// the objects are reused by every game started with ResetGame
+void CreateGameObjects(GameData* gameData, Arena* arena)
+{
+	gameData->arena = arena;
+	ReserveNPCs(arena, &gameData->npcs, NPC_INITIAL_CAPACITY);
+	ReserveBullets(arena, &gameData->bullets, BULLET_INITIAL_CAPACITY);
+
+	gameData->background = ArenaNew<GameObject>(arena);
+	gameData->player = ArenaNew<Player>(arena);
+	gameData->riflePowerup = ArenaNew<GameObject>(arena);
+}
+
+// start a new game in the existing objects, nothing is allocated
+// NPCs and bullets keep the capacity their arrays grew to in the previous games
+void ResetGame(GameData* gameData, SDL_Surface** bitmaps, Uint64 seed)
+{
+	gameData->gameOverTime = 0;
+	gameData->nextObjectSpawnTick = 0;
+	gameData->npcs.count = 0;
+	gameData->bullets.count = 0;
+	gameData->road = RoadProfile();
+
+	for (int i = 0; i < NPC_TYPE_COUNT; i++)
+	{
+		gameData->npcArchetypes[i].explosion0 = bitmaps[BMP_EXPLOSION_0];
+		gameData->npcArchetypes[i].explosion1 = bitmaps[BMP_EXPLOSION_1];
+		gameData->npcArchetypes[i].size = CAR_SIZE;
+	}
+	gameData->npcArchetypes[ENEMY].sprite = bitmaps[BMP_ENEMY_CAR];
+	gameData->npcArchetypes[ENEMY].startSpeed = { 0, -ENEMY_MAX_SPEED };
+	gameData->npcArchetypes[ENEMY].health = ENEMY_HP;
+	gameData->npcArchetypes[CIVILIAN].sprite = bitmaps[BMP_CIVILIAN_CAR];
+	gameData->npcArchetypes[CIVILIAN].startSpeed = { 0, -CIVILIAN_SPEED };
+	gameData->npcArchetypes[CIVILIAN].health = CIVILIAN_HP;
+
+	gameData->seed = seed;
+	for (int i = 0; i < RNG_STREAM_COUNT; i++)
+		SeedRandom(&gameData->random[i], seed, i);
+
+	GameObject* background = gameData->background;
+	*background = GameObject();
+	background->sprite = bitmaps[BMP_BACKGROUND];
+	background->SetPosition({ SCREEN_WIDTH / 2, 0 });
+
+	gameData->grassSprite = bitmaps[BMP_ROAD_EDGE];
+
+	Player* player = gameData->player;
+	*player = Player();
+	player->sprite = bitmaps[BMP_PLAYER_CAR];
+	player->lives = 0;
+	player->deathTime = 0;
+	player->explosion0 = bitmaps[BMP_EXPLOSION_0];
+	player->explosion1 = bitmaps[BMP_EXPLOSION_1];
+	player->SetPosition({ SCREEN_WIDTH / 2, PLAYER_START_POS });
+	player->size = CAR_SIZE;
+
+	gameData->bulletSprite = bitmaps[BMP_BULLET];
+
+	GameObject* powerup = gameData->riflePowerup;
+	*powerup = GameObject();
 	powerup->position = {};
 	powerup->visible = false;
 	powerup->sprite = bitmaps[BMP_RIFLE];
 	powerup->size = POWERUP_SIZE;
-	gameData->riflePowerup = powerup;
+
+	UpdateRoadProfile(&gameData->road, player->distanceCounter);
+}
+
+// remember where every object was before the tick, so frames can be drawn in between ticks
+void SavePreviousPositions(GameData* gameData)
+{
+	gameData->background->previousPosition = gameData->background->position;
+	gameData->player->previousPosition = gameData->player->position;
+	gameData->player->previousDistanceCounter = gameData->player->distanceCounter;
+	gameData->riflePowerup->previousPosition = gameData->riflePowerup->position;
+
+	memcpy(gameData->npcs.previousPosition, gameData->npcs.position, sizeof(Vector2) * gameData->npcs.count);
+	memcpy(gameData->bullets.previousPosition, gameData->bullets.position, sizeof(Vector2) * gameData->bullets.count);
+}
+
+// profiler can be NULL
+void GameUpdate(Time time, GameData* gameData, SDL_Surface** bitmaps, Input* input, Profiler* profiler)
+{
+	int allocationsBefore = GetAllocationCount();
+	SavePreviousPositions(gameData);
+	UpdateRoadProfile(&gameData->road, gameData->player->distanceCounter);
+
+	{
+		ProfileScope scope(profiler, STAGE_UPDATE_PLAYER);
+		UpdatePlayer(time, gameData, bitmaps, input);
+	}
+	{
+		ProfileScope scope(profiler, STAGE_UPDATE_NPCS);
+		UpdateNPCs(time, gameData);
+	}
+	{
+		ProfileScope scope(profiler, STAGE_UPDATE_BULLETS);
+		UpdateBullets(time, gameData);
+	}
+	{
+		ProfileScope scope(profiler, STAGE_OBJECT_SPAWNING);
+		UpdatePowerup(time, gameData->player, gameData->riflePowerup);
+
+		if (!gameData->player->IsDead())
+			ObjectSpawning(gameData, time);
+	}
+	{
+		ProfileScope scope(profiler, STAGE_RESOLVE_COLLISIONS);
+		ResolveCollisions(gameData, time);
+	}
+
+	// everything needed during play comes from the arena
+	SDL_assert(GetAllocationCount() == allocationsBefore);
+}
+
+
+void UpdateInputs(Input* input, SDL_Event event)
+{
+	switch (event.type)
+	{
+	case SDL_KEYDOWN:
+		if (event.key.keysym.sym == SDLK_ESCAPE) input->quit = true;
+		else if (event.key.keysym.sym == SDLK_n) input->newGame = true;
+		else if (event.key.keysym.sym == SDLK_UP) input->up = true;
+		else if (event.key.keysym.sym == SDLK_DOWN) input->down = true;
+		else if (event.key.keysym.sym == SDLK_LEFT) input->left = true;
+		else if (event.key.keysym.sym == SDLK_RIGHT) input->right = true;
+		else if (event.key.keysym.sym == SDLK_SPACE) input->shoot = true;
+		else if (event.key.keysym.sym == SDLK_p) input->pause = true;
+		else if (event.key.keysym.sym == SDLK_s) input->saveScore = true;
+		else if (event.key.keysym.sym == SDLK_t) input->switchScoreSorting = true;
+		else if (event.key.keysym.sym == SDLK_F3) input->showDebug = !input->showDebug; // toggled on keypress
+		break;
+	case SDL_WINDOWEVENT:
+		input->redraw = true;
+		break;
+	case SDL_KEYUP:
+		if (event.key.keysym.sym == SDLK_UP) input->up = false;
+		else if (event.key.keysym.sym == SDLK_DOWN) input->down = false;
+		else if (event.key.keysym.sym == SDLK_LEFT) input->left = false;
+		else if (event.key.keysym.sym == SDLK_RIGHT) input->right = false;
+		else if (event.key.keysym.sym == SDLK_SPACE) input->shoot = false;
+		break;
+	case SDL_QUIT:
+		input->quit = true;
+		break;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// INPUT REPLAYS
+
+// a replay stores the seed of the game and the gameplay input of every tick
+// the input is run-length encoded, since keys are usually held for many ticks
+//
+// file layout (all values little-endian):
+// "SHRP" | version u32 | seed u64 | tick rate u32 | tick count u32 | run count u32
+// followed by run count * (input bits u8 | run length u16)
+
+enum ReplayInputBits
+{
+	REPLAY_UP = 1 << 0,
+	REPLAY_DOWN = 1 << 1,
+	REPLAY_LEFT = 1 << 2,
+	REPLAY_RIGHT = 1 << 3,
+	REPLAY_SHOOT = 1 << 4,
+};
+
+struct ReplayRun
+{
+	Uint8 input;
+	Uint16 length;
+};
+
+struct Replay
+{
+	Uint64 seed = 0;
+	int tickCount = 0;
+
+	int runCount = 0;
+	int runCapacity = 0;
+	ReplayRun* runs = NULL;
+
+	// playback position
+	int playbackRun = 0;
+	int playbackTick = 0;
+};
+
+// only the keys that affect GameUpdate are stored
+Uint8 PackReplayInput(Input* input)
+{
+	Uint8 bits = 0;
+	if (input->up) bits |= REPLAY_UP;
+	if (input->down) bits |= REPLAY_DOWN;
+	if (input->left) bits |= REPLAY_LEFT;
+	if (input->right) bits |= REPLAY_RIGHT;
+	if (input->shoot) bits |= REPLAY_SHOOT;
+	return bits;
+}
+void UnpackReplayInput(Uint8 bits, Input* input)
+{
+	input->up = bits & REPLAY_UP;
+	input->down = bits & REPLAY_DOWN;
+	input->left = bits & REPLAY_LEFT;
+	input->right = bits & REPLAY_RIGHT;
+	input->shoot = bits & REPLAY_SHOOT;
+}
+
+void FreeReplay(Replay* replay)
+{
+	free(replay->runs);
+	*replay = Replay();
+}
+
+// start recording a new game, the memory of the previous recording is reused
+void ResetReplay(Replay* replay, Uint64 seed)
+{
+	replay->seed = seed;
+	replay->tickCount = 0;
+	replay->runCount = 0;
+	replay->playbackRun = 0;
+	replay->playbackTick = 0;
+}
+
+// make room for count more runs, so recording them doesn't allocate
+bool ReserveReplayRuns(Replay* replay, int count)
+{
+	if (replay->runCount + count <= replay->runCapacity)
+		return true;
+
+	int capacity = __max(replay->runCapacity * 2, 64);
+	capacity = __max(capacity, replay->runCount + count);
+	ReplayRun* runs = (ReplayRun*)CountedRealloc(replay->runs, sizeof(ReplayRun) * capacity);
+	if (runs == NULL)
+	{
+		printf("Ran out of memory when recording the replay!\n");
+		return false;
+	}
+	replay->runs = runs;
+	replay->runCapacity = capacity;
+	return true;
+}
+
+// store the input of a single tick
+bool RecordReplayInput(Replay* replay, Input* input)
+{
+	Uint8 bits = PackReplayInput(input);
+	replay->tickCount++;
+
+	ReplayRun* last = replay->runCount > 0 ? &replay->runs[replay->runCount - 1] : NULL;
+	if (last != NULL && last->input == bits && last->length < REPLAY_MAX_RUN_LENGTH)
+	{
+		last->length++;
+		return true;
+	}
+
+	if (!ReserveReplayRuns(replay, 1))
+		return false;
+	replay->runs[replay->runCount] = { bits, 1 };
+	replay->runCount++;
+	return true;
+}
+
+// read the input of the next tick
+// returns false when the replay has ended
+bool PlayReplayInput(Replay* replay, Input* input)
+{
+	if (replay->playbackRun >= replay->runCount)
+		return false;
+
+	UnpackReplayInput(replay->runs[replay->playbackRun].input, input);
+
+	replay->playbackTick++;
+	if (replay->playbackTick >= replay->runs[replay->playbackRun].length)
+	{
+		replay->playbackRun++;
+		replay->playbackTick = 0;
+	}
+	return true;
+}
+
+bool SaveReplay(Replay* replay, const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		printf("Couldn't open %s for writing the replay\n", filename);
+		return false;
+	}
+
+	fwrite(REPLAY_MAGIC, 1, 4, file);
+	WriteLE(file, REPLAY_VERSION, 4);
+	WriteLE(file, replay->seed, 8);
+	WriteLE(file, SIM_TICK_RATE, 4);
+	WriteLE(file, replay->tickCount, 4);
+	WriteLE(file, replay->runCount, 4);
+	for (int i = 0; i < replay->runCount; i++)
+	{
+		WriteLE(file, replay->runs[i].input, 1);
+		WriteLE(file, replay->runs[i].length, 2);
+	}
+
+	bool success = !ferror(file);
+	fclose(file);
+
+	if (success)
+		printf("Saved replay %s (%d ticks, %d runs)\n", filename, replay->tickCount, replay->runCount);
+	else
+		printf("Error while writing the replay %s\n", filename);
+	return success;
+}
+
+bool LoadReplay(Replay* replay, const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		printf("Couldn't open the replay %s\n", filename);
+		return false;
+	}
+
+	char magic[4] = {};
+	bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0;
+	valid = valid && ReadLE(file, 4) == REPLAY_VERSION;
+
+	Uint64 seed = ReadLE(file, 8);
+	int tickRate = (int)ReadLE(file, 4);
+	if (valid && tickRate != SIM_TICK_RATE)
+	{
+		printf("Replay %s was recorded at %d ticks per second, but the game runs at %d\n", filename, tickRate, SIM_TICK_RATE);
+		fclose(file);
+		return false;
+	}
+	int tickCount = (int)ReadLE(file, 4);
+	int runCount = (int)ReadLE(file, 4);
+
+	if (!valid || feof(file) || runCount < 0)
+	{
+		printf("%s is not a valid replay file\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	ResetReplay(replay, seed);
+	replay->runCapacity = runCount;
+	replay->runs = (ReplayRun*)CountedRealloc(replay->runs, sizeof(ReplayRun) * __max(runCount, 1));
+	if (replay->runs == NULL)
+	{
+		printf("Ran out of memory when loading the replay!\n");
+		fclose(file);
+		return false;
+	}
+	for (int i = 0; i < runCount; i++)
+	{
+		replay->runs[i].input = (Uint8)ReadLE(file, 1);
+		replay->runs[i].length = (Uint16)ReadLE(file, 2);
+	}
+	replay->runCount = runCount;
+	replay->tickCount = tickCount;
+
+	valid = !feof(file);
+	fclose(file);
+
+	if (!valid)
+		printf("Replay %s is truncated\n", filename);
+	return valid;
+}
+
+// replays are saved as <prefix>_<game number>.rpl
+void SaveRecordedGame(Replay* replay, const char* prefix, int gameNumber)
+{
+	char filename[STRING_BUFFER_SIZE] = "";
+	snprintf(filename, STRING_BUFFER_SIZE, "%s_%d.rpl", prefix, gameNumber);
+	SaveReplay(replay, filename);
+}
+
+// FNV-1a hash of the simulation state, used to check that a replay reproduces a run exactly
+void HashBytes(Uint64* hash, const void* data, int size)
+{
+	const Uint8* bytes = (const Uint8*)data;
+	for (int i = 0; i < size; i++)
+	{
+		*hash ^= bytes[i];
+		*hash *= 0x100000001B3ULL;
+	}
+}
+Uint64 HashGameState(GameData* gameData)
+{
+	Uint64 hash = 0xCBF29CE484222325ULL;
+	Player* player = gameData->player;
+	HashBytes(&hash, &player->position, sizeof(player->position));
+	HashBytes(&hash, &player->speed, sizeof(player->speed));
+	HashBytes(&hash, &player->distanceCounter, sizeof(player->distanceCounter));
+	HashBytes(&hash, &player->score, sizeof(player->score));
+	HashBytes(&hash, &player->lives, sizeof(player->lives));
+	NPCStore* npcs = &gameData->npcs;
+	HashBytes(&hash, &npcs->count, sizeof(npcs->count));
+	for (int i = 0; i < npcs->count; i++)
+	{
+		HashBytes(&hash, &npcs->position[i], sizeof(npcs->position[i]));
+		HashBytes(&hash, &npcs->speed[i], sizeof(npcs->speed[i]));
+		HashBytes(&hash, &npcs->health[i], sizeof(npcs->health[i]));
+	}
+	return hash;
+}
+
+
+
+// advance the game clock by one fixed tick
+void AdvanceTick(Time* time)
+{
+	time->ticks++;
+	time->gametime = time->ticks * SIM_TICK_DELTA;
+	time->delta = SIM_TICK_DELTA;
+}
+
+// run as many fixed ticks as fit in the real time that has passed
+// the remainder is kept for the next frame and used for interpolation
+// when recording isn't NULL, the input of every tick is stored in it
+void RunSimulation(Time* time, GameData* gameData, SDL_Surface** bitmaps, Input* input, Replay* recording, Profiler* profiler)
+{
+	if (time->paused) return;
+
+	time->accumulator += Clamp(time->frameDelta, 0, SIM_MAX_FRAME_DELTA);
+
+	// every tick adds at most one run to the recording and traces one event per game logic stage
+	// (the stages before STAGE_DRAW_GAME_OBJECTS), the room for them is made before the ticks
+	int ticks = (int)(time->accumulator / SIM_TICK_DELTA);
+	if (recording != NULL)
+		ReserveReplayRuns(recording, ticks);
+	if (profiler != NULL)
+		ReserveTraceEvents(profiler, ticks * STAGE_DRAW_GAME_OBJECTS);
+
+	while (time->accumulator >= SIM_TICK_DELTA)
+	{
+		int allocationsBefore = GetAllocationCount();
+		AdvanceTick(time);
+		if (recording != NULL)
+			RecordReplayInput(recording, input);
+		GameUpdate(*time, gameData, bitmaps, input, profiler);
+		time->accumulator -= SIM_TICK_DELTA;
+
+		// a whole tick, recording included, doesn't allocate
+		SDL_assert(GetAllocationCount() == allocationsBefore);
+	}
+	time->alpha = time->accumulator / SIM_TICK_DELTA;
+}
+
+void MeasureTime(Time* time)
+{
+	time->timeCounterCurrent = SDL_GetPerformanceCounter();
+	time->frameDelta = ((double)(time->timeCounterCurrent - time->timeCounterPrevious) / (double)SDL_GetPerformanceFrequency());
+	time->timeCounterPrevious = time->timeCounterCurrent;
+
+	time->time += time->frameDelta;
+
+
+	// measure the FPS
+	time->fpsTimer += time->frameDelta;
+	if (time->fpsTimer > FPS_COUNTER_INTERVAL)
+	{
+		time->fps = time->frames / FPS_COUNTER_INTERVAL;
+		time->frames = 0;
+		time->fpsTimer = 0;
+	}
+}
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// SAVING
+
+struct Highscore
+{
+	int score;
+	int time; // in miliseconds
+};
+
+// highscore records are used straight from the memory mapped file,
+// so their layout has to match the file (two little-endian 32 bit integers)
+SDL_COMPILE_TIME_ASSERT(highscore_size, sizeof(Highscore) == HIGHSCORES_RECORD_SIZE);
+SDL_COMPILE_TIME_ASSERT(highscore_byte_order, SDL_BYTEORDER == SDL_LIL_ENDIAN);
+
+// FNV-1a, data can be appended to a checksum by passing the previous value
+Uint32 ChecksumBytes(Uint32 checksum, const void* data, size_t size)
+{
+	const Uint8* bytes = (const Uint8*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		checksum ^= bytes[i];
+		checksum *= 16777619u;
+	}
+	return checksum;
+}
+
+Uint32 ChecksumHighscores(Uint32 checksum, const Highscore* highscores, int count)
+{
+	return ChecksumBytes(checksum, highscores, (size_t)count * sizeof(Highscore));
+}
+
+void WriteHighscoreStoreHeader(FILE* file, int recordCount, Uint32 checksum)
+{
+	fwrite(HIGHSCORES_MAGIC, 1, 4, file);
+	WriteLE(file, HIGHSCORES_VERSION, 4);
+	WriteLE(file, recordCount, 4);
+	WriteLE(file, checksum, 4);
+}
+
+// write a new highscore store containing the given records
+// returns true when successful
+bool WriteHighscoreStore(const char* filename, const Highscore* highscores, int count)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		printf("Couldn't open %s for writing the highscores\n", filename);
+		return false;
+	}
+
+	WriteHighscoreStoreHeader(file, count, ChecksumHighscores(HIGHSCORES_CHECKSUM_SEED, highscores, count));
+	fwrite(highscores, sizeof(Highscore), count, file);
+
+	bool success = !ferror(file);
+	fclose(file);
+	if (!success)
+		printf("Error while writing the highscores to %s\n", filename);
+	return success;
+}
+
+// read highscores saved in the old text format (score and time on separate lines)
+// the records are added to a growable array
+// returns false when the file doesn't exist or there isn't enough memory
+bool ReadTextHighscores(const char* filename, Highscore** highscores, int* count, int* capacity)
+{
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+		return false;
+
+	char stringBuffer[STRING_BUFFER_SIZE] = "";
+	while (fgets(stringBuffer, STRING_BUFFER_SIZE, file))
+	{
+		Highscore highscore = {};
+		highscore.score = atoi(stringBuffer);
+		fgets(stringBuffer, STRING_BUFFER_SIZE, file);
+		highscore.time = atoi(stringBuffer);
+
+		if (*count >= *capacity)
+		{
+			int newCapacity = __max(*capacity * 2, 64);
+			Highscore* grown = (Highscore*)CountedRealloc(*highscores, sizeof(Highscore) * newCapacity);
+			if (grown == NULL)
+			{
+				printf("Ran out of memory when reading %s!\n", filename);
+				fclose(file);
+				return false;
+			}
+			*highscores = grown;
+			*capacity = newCapacity;
+		}
+		(*highscores)[*count] = highscore;
+		(*count)++;
+	}
+
+	fclose(file);
+	return true;
+}
+
+// create the highscore store from the text files used by older versions of the game
+// this only happens once, when the store doesn't exist yet
+bool ImportTextHighscores(const char* storeFilename)
+{
+	const char* textFiles[] = HIGHSCORES_TEXT_FILES;
+	Highscore* highscores = NULL;
+	int count = 0;
+	int capacity = 0;
+
+	for (int i = 0; i < (int)(sizeof(textFiles) / sizeof(textFiles[0])); i++)
+	{
+		int before = count;
+		if (ReadTextHighscores(textFiles[i], &highscores, &count, &capacity))
+			printf("Imported %d highscores from %s\n", count - before, textFiles[i]);
+	}
+
+	bool success = WriteHighscoreStore(storeFilename, highscores, count);
+	free(highscores);
+	return success;
+}
+
+// a saved score as it is written to the journal
+// the number is the position the record gets in HIGHSCORES_FILE
+struct JournalRecord
+{
+	Uint32 number;
+	Highscore highscore;
+	Uint32 checksum;
+};
+
+SDL_COMPILE_TIME_ASSERT(journal_record_size, sizeof(JournalRecord) == HIGHSCORES_JOURNAL_RECORD_SIZE);
+
+Uint32 ChecksumJournalRecord(const JournalRecord* record)
+{
+	return ChecksumBytes(HIGHSCORES_CHECKSUM_SEED, record, offsetof(JournalRecord, checksum));
+}
+
+// flush a file all the way to the disk
+bool SyncFile(FILE* file)
+{
+	if (fflush(file) != 0)
+		return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+// append the records saved in the journal to the highscore store and delete the journal
+// a record that was only partially written (the game was closed while saving) ends the journal
+// records that were already appended before are skipped, so this can be interrupted at any point
+bool FoldHighscoreJournal(const char* storeFilename, const char* journalFilename)
+{
+	FILE* journal = fopen(journalFilename, "rb");
+	if (journal == NULL)
+		return true; // nothing was saved since the last start
+
+	FILE* store = fopen(storeFilename, "r+b");
+	Uint8 header[HIGHSCORES_HEADER_SIZE];
+	if (store == NULL || fread(header, 1, HIGHSCORES_HEADER_SIZE, store) != HIGHSCORES_HEADER_SIZE)
+	{
+		printf("Couldn't open %s for saving the scores from %s\n", storeFilename, journalFilename);
+		if (store != NULL) fclose(store);
+		fclose(journal);
+		return false;
+	}
+
+	Uint32 recordCount = SDL_SwapLE32(*(Uint32*)(header + 8));
+	Uint32 checksum = SDL_SwapLE32(*(Uint32*)(header + 12));
+	int folded = 0;
+
+	// the records go after the last one in the header, the header is updated once they're on the disk
+	fseek(store, HIGHSCORES_HEADER_SIZE + (long)recordCount * HIGHSCORES_RECORD_SIZE, SEEK_SET);
+	JournalRecord record;
+	while (fread(&record, sizeof(JournalRecord), 1, journal) == 1 &&
+		ChecksumJournalRecord(&record) == record.checksum)
+	{
+		if (record.number < recordCount)
+			continue;
+
+		fwrite(&record.highscore, sizeof(Highscore), 1, store);
+		checksum = ChecksumHighscores(checksum, &record.highscore, 1);
+		recordCount++;
+		folded++;
+	}
+	fclose(journal);
+
+	bool success = true;
+	if (folded > 0)
+	{
+		success = SyncFile(store);
+		fseek(store, 0, SEEK_SET);
+		WriteHighscoreStoreHeader(store, recordCount, checksum);
+		success = success && SyncFile(store) && !ferror(store);
+	}
+	fclose(store);
+
+	if (!success)
+	{
+		printf("Error while saving the scores from %s to %s\n", journalFilename, storeFilename);
+		return false;
+	}
+	remove(journalFilename);
+	return true;
+}
+
+// saved scores are passed to a background thread, so the game never waits for the disk
+// the queue has a single producer (the game) and a single consumer (the writer thread)
+struct ScoreWriter
+{
+	JournalRecord queue[SCORE_QUEUE_SIZE];
+	SDL_atomic_t head; // number of records queued by the game
+	SDL_atomic_t tail; // number of records taken by the writer thread
+	SDL_atomic_t quit;
+	SDL_sem* wakeUp;
+	SDL_Thread* thread;
+	FILE* journal;
+};
+
+// returns false when the queue is full
+bool QueueScore(ScoreWriter* writer, JournalRecord record)
+{
+	int head = SDL_AtomicGet(&writer->head);
+	if (head - SDL_AtomicGet(&writer->tail) >= SCORE_QUEUE_SIZE)
+		return false;
+
+	writer->queue[head % SCORE_QUEUE_SIZE] = record;
+	SDL_AtomicSet(&writer->head, head + 1); // publishes the record
+	SDL_SemPost(writer->wakeUp);
+	return true;
+}
+
+// takes everything queued since the last batch and writes it with a single flush
+int ScoreWriterThread(void* data)
+{
+	ScoreWriter* writer = (ScoreWriter*)data;
+	JournalRecord batch[SCORE_QUEUE_SIZE];
+
+	while (true)
+	{
+		SDL_SemWait(writer->wakeUp);
+		bool quit = SDL_AtomicGet(&writer->quit);
+
+		int tail = SDL_AtomicGet(&writer->tail);
+		int head = SDL_AtomicGet(&writer->head);
+		int count = 0;
+		for (; tail != head; tail++, count++)
+			batch[count] = writer->queue[tail % SCORE_QUEUE_SIZE];
+		SDL_AtomicSet(&writer->tail, tail);
+
+		if (count > 0 &&
+			(fwrite(batch, sizeof(JournalRecord), count, writer->journal) != (size_t)count || !SyncFile(writer->journal)))
+			printf("Error while saving %d scores to %s\n", count, HIGHSCORES_JOURNAL_FILE);
+
+		if (quit)
+			return 0;
+	}
+}
+
+// returns NULL when the journal can't be opened
+ScoreWriter* StartScoreWriter(const char* journalFilename)
+{
+	FILE* journal = fopen(journalFilename, "ab");
+	if (journal == NULL)
+	{
+		printf("Couldn't open %s for saving the scores\n", journalFilename);
+		return NULL;
+	}
+
+	ScoreWriter* writer = (ScoreWriter*)CountedCalloc(1, sizeof(ScoreWriter));
+	if (writer == NULL)
+	{
+		printf("Ran out of memory when starting the score writer!\n");
+		fclose(journal);
+		return NULL;
+	}
+	writer->journal = journal;
+	writer->wakeUp = SDL_CreateSemaphore(0);
+	if (writer->wakeUp != NULL)
+		writer->thread = SDL_CreateThread(ScoreWriterThread, "ScoreWriter", writer);
+	if (writer->thread == NULL)
+	{
+		printf("Couldn't start the score writer: %s\n", SDL_GetError());
+		if (writer->wakeUp != NULL) SDL_DestroySemaphore(writer->wakeUp);
+		fclose(journal);
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+// write records to the journal right away, only used when the game is closing
+bool AppendJournalRecords(const char* journalFilename, const JournalRecord* records, int count)
+{
+	FILE* journal = fopen(journalFilename, "ab");
+	if (journal == NULL)
+	{
+		printf("Couldn't open %s for saving the scores\n", journalFilename);
+		return false;
+	}
+	bool success = fwrite(records, sizeof(JournalRecord), count, journal) == (size_t)count && SyncFile(journal);
+	fclose(journal);
+	return success;
+}
+
+// waits until all queued scores are written
+void StopScoreWriter(ScoreWriter* writer)
+{
+	if (writer == NULL)
+		return;
+
+	SDL_AtomicSet(&writer->quit, 1);
+	SDL_SemPost(writer->wakeUp);
+	SDL_WaitThread(writer->thread, NULL);
+
+	SDL_DestroySemaphore(writer->wakeUp);
+	fclose(writer->journal);
+	free(writer);
+}
+
+enum LeaderboardSortMode
+{
+	SORT_BY_SCORE,
+	SORT_BY_TIME,
+	SORT_MODE_COUNT
+};
+
+// a highscore together with its number (see GetHighscore)
+// the number decides the order of equal highscores
+struct RankedHighscore
+{
+	Highscore highscore;
+	int index;
+};
+
+// the part of the sorted leaderboard that is kept in memory
+// rows[0] is the highscore ranked at position start (counting from 0)
+struct LeaderboardWindow
+{
+	int start = 0;
+	int count = 0;
+	RankedHighscore rows[LEADERBOARD_WINDOW];
+};
+
+struct Leaderboard
+{
+	LeaderboardSortMode sortMode = SORT_BY_SCORE;
+	int displayOffset = 0;
+	double nextScrollTime = 0;
+	int scoreCount = 0; // stored and added highscores
+
+	// highscores from HIGHSCORES_FILE, used straight from the memory mapping
+	MappedFile store;
+	const Highscore* storedScores = NULL;
+	int storedCount = 0;
+
+	// highscores saved while the game is running
+	int addedCapacity = 0;
+	int addedCount = 0;
+	Highscore* addedScores = NULL;
+
+	ScoreWriter* writer = NULL;
+	double nextWriterStart = 0; // when to try starting the writer again if it failed
+
+	// saved scores that didn't fit into the writer's queue yet, they're retried every frame
+	int pendingCapacity = 0;
+	int pendingCount = 0;
+	JournalRecord* pendingScores = NULL;
+
+	// Fenwick tree counting the highscores in every score bucket
+	int* scoreRanking = NULL;
+
+	// only a window of every sort mode is kept sorted in memory
+	// more rows are paged in from the file when the leaderboard is scrolled past the window
+	LeaderboardWindow windows[SORT_MODE_COUNT];
+};
+
+// highscores are numbered with the stored ones first, then the added ones
+Highscore GetHighscore(Leaderboard* leaderboard, int index)
+{
+	if (index < leaderboard->storedCount)
+		return leaderboard->storedScores[index];
+	return leaderboard->addedScores[index - leaderboard->storedCount];
 }
 
-void GameUpdate(Time time, GameData* gameData, SDL_Surface** bitmaps, Input* input)
+// returns true when highscore a should be displayed above highscore b
+// equal highscores keep the order in which they were added
+bool RanksHigher(RankedHighscore a, RankedHighscore b, LeaderboardSortMode sortMode)
 {
-	UpdatePlayer(time, gameData, bitmaps, input);
-	UpdateNPCs(time, gameData);
-	UpdateBullets(time, gameData);
-	UpdatePowerup(time, gameData->player, gameData->riflePowerup);
+	int keyA = sortMode == SORT_BY_SCORE ? a.highscore.score : a.highscore.time;
+	int keyB = sortMode == SORT_BY_SCORE ? b.highscore.score : b.highscore.time;
+	if (keyA != keyB)
+		return keyA > keyB;
+	return a.index < b.index;
+}
 
-	if (!gameData->player->IsDead())
-		ObjectSpawning(gameData, bitmaps, time);
+// the highscores closest to a boundary are selected with a binary heap
+// its root is the selected highscore that is the furthest from the boundary, so it's replaced first
+// below is true when the selected highscores rank below the boundary
+bool IsFurtherFromBoundary(RankedHighscore a, RankedHighscore b, LeaderboardSortMode sortMode, bool below)
+{
+	return below ? RanksHigher(b, a, sortMode) : RanksHigher(a, b, sortMode);
+}
+
+void SiftHeapDown(RankedHighscore* heap, int count, int i, LeaderboardSortMode sortMode, bool below)
+{
+	while (true)
+	{
+		int furthest = i;
+		int left = i * 2 + 1;
+		int right = i * 2 + 2;
+		if (left < count && IsFurtherFromBoundary(heap[left], heap[furthest], sortMode, below))
+			furthest = left;
+		if (right < count && IsFurtherFromBoundary(heap[right], heap[furthest], sortMode, below))
+			furthest = right;
+		if (furthest == i)
+			return;
 
-	ResolveCollisions(gameData, time);
+		RankedHighscore temp = heap[i];
+		heap[i] = heap[furthest];
+		heap[furthest] = temp;
+		i = furthest;
+	}
 }
 
+void SiftHeapUp(RankedHighscore* heap, int i, LeaderboardSortMode sortMode, bool below)
+{
+	while (i > 0 && IsFurtherFromBoundary(heap[i], heap[(i - 1) / 2], sortMode, below))
+	{
+		RankedHighscore temp = heap[i];
+		heap[i] = heap[(i - 1) / 2];
+		heap[(i - 1) / 2] = temp;
+		i = (i - 1) / 2;
+	}
+}
 
-void UpdateInputs(Input* input, SDL_Event event)
+// streams all highscores and keeps the (at most) maxCount that rank closest to the boundary
+// with below = true they are the highscores ranked right below the boundary, otherwise right above it
+// a NULL boundary selects the best highscores
+// the result is sorted from the best to the worst, returns the number of selected highscores
+int SelectHighscores(Leaderboard* leaderboard, LeaderboardSortMode sortMode, RankedHighscore* boundary, bool below, RankedHighscore* result, int maxCount)
 {
-	switch (event.type)
+	int count = 0;
+	for (int i = 0; i < leaderboard->scoreCount; i++)
 	{
-	case SDL_KEYDOWN:
-		if (event.key.keysym.sym == SDLK_ESCAPE) input->quit = true;
-		else if (event.key.keysym.sym == SDLK_n) input->newGame = true;
-		else if (event.key.keysym.sym == SDLK_UP) input->up = true;
-		else if (event.key.keysym.sym == SDLK_DOWN) input->down = true;
-		else if (event.key.keysym.sym == SDLK_LEFT) input->left = true;
-		else if (event.key.keysym.sym == SDLK_RIGHT) input->right = true;
-		else if (event.key.keysym.sym == SDLK_SPACE) input->shoot = true;
-		else if (event.key.keysym.sym == SDLK_p) input->pause = true;
-		else if (event.key.keysym.sym == SDLK_s) input->saveScore = true;
-		else if (event.key.keysym.sym == SDLK_t) input->switchScoreSorting = true;
-		else if (event.key.keysym.sym == SDLK_F3) input->showDebug = !input->showDebug; // toggled on keypress
-		break;
-	case SDL_KEYUP:
-		if (event.key.keysym.sym == SDLK_UP) input->up = false;
-		else if (event.key.keysym.sym == SDLK_DOWN) input->down = false;
-		else if (event.key.keysym.sym == SDLK_LEFT) input->left = false;
-		else if (event.key.keysym.sym == SDLK_RIGHT) input->right = false;
-		else if (event.key.keysym.sym == SDLK_SPACE) input->shoot = false;
-		break;
-	case SDL_QUIT:
-		input->quit = true;
-		break;
+		RankedHighscore highscore = { GetHighscore(leaderboard, i), i };
+		if (boundary != NULL && !IsFurtherFromBoundary(highscore, *boundary, sortMode, below))
+			continue;
+
+		if (count < maxCount)
+		{
+			result[count] = highscore;
+			SiftHeapUp(result, count, sortMode, below);
+			count++;
+		}
+		else if (maxCount > 0 && IsFurtherFromBoundary(result[0], highscore, sortMode, below))
+		{
+			result[0] = highscore;
+			SiftHeapDown(result, count, 0, sortMode, below);
+		}
+	}
+
+	// heap sort, the highscores furthest from the boundary end up at the back
+	for (int last = count - 1; last > 0; last--)
+	{
+		RankedHighscore temp = result[0];
+		result[0] = result[last];
+		result[last] = temp;
+		SiftHeapDown(result, last, 0, sortMode, below);
+	}
+
+	// above the boundary the furthest highscores are the best ones, they belong at the front
+	if (!below)
+	{
+		for (int i = 0; i < count / 2; i++)
+		{
+			RankedHighscore temp = result[i];
+			result[i] = result[count - 1 - i];
+			result[count - 1 - i] = temp;
+		}
 	}
+	return count;
 }
 
+// page in the rows right below the window, the top half of the window is dropped
+void PageLeaderboardForward(Leaderboard* leaderboard, LeaderboardSortMode sortMode)
+{
+	LeaderboardWindow* window = &leaderboard->windows[sortMode];
+	int kept = __min(window->count, LEADERBOARD_WINDOW / 2);
+	int dropped = window->count - kept;
+	memmove(&window->rows[0], &window->rows[dropped], sizeof(RankedHighscore) * kept);
+	window->start += dropped;
+
+	RankedHighscore* boundary = kept > 0 ? &window->rows[kept - 1] : NULL;
+	window->count = kept + SelectHighscores(leaderboard, sortMode, boundary, true, &window->rows[kept], LEADERBOARD_WINDOW - kept);
+}
 
-void MeasureTime(Time* time)
+// page in the rows right above the window, the bottom half of the window is dropped
+void PageLeaderboardBackward(Leaderboard* leaderboard, LeaderboardSortMode sortMode)
 {
-	time->timeCounterCurrent = SDL_GetPerformanceCounter();
-	time->delta = ((double)(time->timeCounterCurrent - time->timeCounterPrevious) / (double)SDL_GetPerformanceFrequency());
-	time->timeCounterPrevious = time->timeCounterCurrent;
+	LeaderboardWindow* window = &leaderboard->windows[sortMode];
+	int kept = __min(window->count, LEADERBOARD_WINDOW / 2);
+	if (kept == 0)
+	{
+		// an empty window has no row to page from, it's filled again from the best highscore
+		window->start = 0;
+		window->count = SelectHighscores(leaderboard, sortMode, NULL, true, &window->rows[0], LEADERBOARD_WINDOW);
+		return;
+	}
 
-	time->time += time->delta;
-	if (!time->paused)
-		time->gametime += time->delta;
+	int added = __min(LEADERBOARD_WINDOW - kept, window->start);
+	memmove(&window->rows[added], &window->rows[0], sizeof(RankedHighscore) * kept);
 
+	RankedHighscore boundary = window->rows[added];
+	SelectHighscores(leaderboard, sortMode, &boundary, false, &window->rows[0], added);
+	window->start -= added;
+	window->count = kept + added;
+}
 
-	// measure the FPS
-	time->fpsTimer += time->delta;
-	if (time->fpsTimer > FPS_COUNTER_INTERVAL)
+// make sure that all rows displayed from displayOffset are in the window
+void UpdateLeaderboardWindow(Leaderboard* leaderboard, LeaderboardSortMode sortMode)
+{
+	LeaderboardWindow* window = &leaderboard->windows[sortMode];
+	int first = leaderboard->displayOffset;
+	int last = __min(first + LEADERBOARD_LENGTH, leaderboard->scoreCount);
+
+	while (first < window->start)
+		PageLeaderboardBackward(leaderboard, sortMode);
+	while (last > window->start + window->count)
+		PageLeaderboardForward(leaderboard, sortMode);
+}
+
+// returns the highscore displayed at the given position, it has to be in the window
+Highscore GetLeaderboardRow(Leaderboard* leaderboard, int position)
+{
+	LeaderboardWindow* window = &leaderboard->windows[leaderboard->sortMode];
+	return window->rows[position - window->start].highscore;
+}
+
+// the ranking counts the highscores in score buckets with a Fenwick tree
+// both counting and adding a highscore take O(log SCORE_RANK_BUCKETS)
+int GetScoreBucket(int score)
+{
+	int bucket = score / SCORE_RANK_BUCKET_SIZE;
+	if (bucket < 0) return 0;
+	if (bucket >= SCORE_RANK_BUCKETS) return SCORE_RANK_BUCKETS - 1;
+	return bucket;
+}
+
+void AddToScoreRanking(Leaderboard* leaderboard, int score)
+{
+	for (int i = GetScoreBucket(score) + 1; i <= SCORE_RANK_BUCKETS; i += i & -i)
+		leaderboard->scoreRanking[i]++;
+}
+
+// number of highscores in the buckets up to and including the given one
+int CountScoresInBuckets(Leaderboard* leaderboard, int bucket)
+{
+	int count = 0;
+	for (int i = bucket + 1; i > 0; i -= i & -i)
+		count += leaderboard->scoreRanking[i];
+	return count;
+}
+
+// the tree is built from the bucket counts in O(n), without adding the highscores one by one
+bool BuildScoreRanking(Leaderboard* leaderboard)
+{
+	// index 0 is unused, Fenwick trees count from 1
+	leaderboard->scoreRanking = (int*)CountedCalloc(SCORE_RANK_BUCKETS + 1, sizeof(int));
+	if (leaderboard->scoreRanking == NULL)
 	{
-		time->fps = time->frames / FPS_COUNTER_INTERVAL;
-		time->frames = 0;
-		time->fpsTimer = 0;
+		printf("Ran out of memory when ranking the highscores!\n");
+		return false;
+	}
+
+	int* tree = leaderboard->scoreRanking;
+	for (int i = 0; i < leaderboard->scoreCount; i++)
+		tree[GetScoreBucket(GetHighscore(leaderboard, i).score) + 1]++;
+	for (int i = 1; i <= SCORE_RANK_BUCKETS; i++)
+	{
+		int parent = i + (i & -i);
+		if (parent <= SCORE_RANK_BUCKETS)
+			tree[parent] += tree[i];
+	}
+	return true;
+}
+
+// the position the score would get on the leaderboard sorted by score (counting from 1)
+// it goes below the highscores that are equal to it, like a newly saved score
+int GetScoreRank(Leaderboard* leaderboard, int score)
+{
+	if (leaderboard->scoreRanking == NULL)
+		return 1;
+	return 1 + leaderboard->scoreCount - CountScoresInBuckets(leaderboard, GetScoreBucket(score) - 1);
+}
+
+void ScrollLeaderboard(Leaderboard* leaderboard, Input input, Time time)
+{
+	if ((input.up || input.down) &&
+		time.time >= leaderboard->nextScrollTime)
+	{
+		leaderboard->nextScrollTime = time.time + LEADERBOARD_SCROLL_DELAY;
+
+		if (input.up)
+			leaderboard->displayOffset--;
+		if (input.down)
+			leaderboard->displayOffset++;
+
+
+		if (leaderboard->displayOffset > leaderboard->scoreCount - LEADERBOARD_LENGTH)
+			leaderboard->displayOffset = leaderboard->scoreCount - LEADERBOARD_LENGTH;
+
+		if (leaderboard->displayOffset < 0)
+			leaderboard->displayOffset = 0;
+
+		UpdateLeaderboardWindow(leaderboard, leaderboard->sortMode);
+	}
+}
+
+// every sort mode keeps its own window, so switching doesn't have to page anything in
+// when the displayed rows aren't in the other window, the leaderboard jumps to its start
+void SwitchLeaderboardSorting(Leaderboard* leaderboard)
+{
+	if (leaderboard->sortMode == SORT_BY_SCORE)
+		leaderboard->sortMode = SORT_BY_TIME;
+	else
+		leaderboard->sortMode = SORT_BY_SCORE;
+
+	LeaderboardWindow* window = &leaderboard->windows[leaderboard->sortMode];
+	int last = __min(leaderboard->displayOffset + LEADERBOARD_LENGTH, leaderboard->scoreCount);
+	if (leaderboard->displayOffset < window->start || last > window->start + window->count)
+		leaderboard->displayOffset = window->start;
+}
+
+// put a new highscore into the window if it belongs there
+// the highscore has to be counted in scoreCount already
+void InsertIntoLeaderboardWindow(Leaderboard* leaderboard, LeaderboardSortMode sortMode, RankedHighscore highscore)
+{
+	LeaderboardWindow* window = &leaderboard->windows[sortMode];
+	bool reachesEnd = window->start + window->count == leaderboard->scoreCount - 1;
+
+	// ranked above the window, every row in it moves one position down
+	if (window->start > 0 && (window->count == 0 || RanksHigher(highscore, window->rows[0], sortMode)))
+	{
+		window->start++;
+		return;
+	}
+
+	int low = 0;
+	int high = window->count;
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (RanksHigher(window->rows[middle], highscore, sortMode))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	// below the window, unless the window goes to the end of the leaderboard
+	if (low == window->count && !reachesEnd)
+		return;
+	// the last row falls out of a full window
+	if (window->count == LEADERBOARD_WINDOW)
+	{
+		if (low == window->count)
+			return;
+		window->count--;
+	}
+
+	memmove(&window->rows[low + 1], &window->rows[low], sizeof(RankedHighscore) * (window->count - low));
+	window->rows[low] = highscore;
+	window->count++;
+}
+
+bool AddScoreToLeaderboard(Leaderboard* leaderboard, Highscore score)
+{
+	if (leaderboard->addedCount >= leaderboard->addedCapacity)
+	{
+		int capacity = __max(leaderboard->addedCapacity * 2, 16);
+		Highscore* addedScores = (Highscore*)CountedRealloc(leaderboard->addedScores, sizeof(Highscore) * capacity);
+		if (addedScores == NULL)
+		{
+			printf("Ran out of memory when adding the highscore!\n");
+			return false;
+		}
+		leaderboard->addedScores = addedScores;
+		leaderboard->addedCapacity = capacity;
+	}
+
+	leaderboard->addedScores[leaderboard->addedCount] = score;
+	leaderboard->addedCount++;
+
+	RankedHighscore ranked = { score, leaderboard->scoreCount };
+	leaderboard->scoreCount++;
+	if (leaderboard->scoreRanking != NULL)
+		AddToScoreRanking(leaderboard, score.score);
+
+	for (int mode = 0; mode < SORT_MODE_COUNT; mode++)
+		InsertIntoLeaderboardWindow(leaderboard, (LeaderboardSortMode)mode, ranked);
+
+	return true;
+}
+
+// passes the pending scores to the writer thread, in the order they were saved
+// (re)starts the writer first if it isn't running, at most every SCORE_WRITER_RETRY_DELAY seconds
+void FlushPendingScores(Leaderboard* leaderboard, double time)
+{
+	if (leaderboard->pendingCount == 0)
+		return;
+
+	if (leaderboard->writer == NULL && time >= leaderboard->nextWriterStart)
+	{
+		leaderboard->writer = StartScoreWriter(HIGHSCORES_JOURNAL_FILE);
+		leaderboard->nextWriterStart = time + SCORE_WRITER_RETRY_DELAY;
+	}
+	if (leaderboard->writer == NULL)
+		return;
+
+	int queued = 0;
+	while (queued < leaderboard->pendingCount && QueueScore(leaderboard->writer, leaderboard->pendingScores[queued]))
+		queued++;
+
+	leaderboard->pendingCount -= queued;
+	memmove(leaderboard->pendingScores, leaderboard->pendingScores + queued, sizeof(JournalRecord) * leaderboard->pendingCount);
+}
+
+void FreeLeaderboard(Leaderboard* leaderboard)
+{
+	// the game is closing: one last attempt to start the writer, what it can't take is written here
+	FlushPendingScores(leaderboard, leaderboard->nextWriterStart);
+	StopScoreWriter(leaderboard->writer);
+	if (leaderboard->pendingCount > 0 &&
+		!AppendJournalRecords(HIGHSCORES_JOURNAL_FILE, leaderboard->pendingScores, leaderboard->pendingCount))
+		printf("Couldn't save %d scores, they are lost\n", leaderboard->pendingCount);
+
+	UnmapFile(&leaderboard->store);
+	free(leaderboard->pendingScores);
+	free(leaderboard->addedScores);
+	free(leaderboard->scoreRanking);
+	*leaderboard = Leaderboard();
+}
+
+// the leaderboard is updated right away, the score is written to the disk in the background
+void SaveScore(Leaderboard* leaderboard, int score, double time)
+{
+	Highscore highscore = { score, (int)(time * 1000) };
+	if (!AddScoreToLeaderboard(leaderboard, highscore))
+		return;
+
+	JournalRecord record = { (Uint32)(leaderboard->scoreCount - 1), highscore, 0 };
+	record.checksum = ChecksumJournalRecord(&record);
+
+	// the score is already on the leaderboard, so it has to reach the journal as well
+	// it waits in the pending list until the writer has room, FlushPendingScores retries it every frame
+	if (leaderboard->pendingCount == 0 && leaderboard->writer != NULL && QueueScore(leaderboard->writer, record))
+		return;
+
+	if (leaderboard->pendingCount >= leaderboard->pendingCapacity)
+	{
+		int capacity = __max(leaderboard->pendingCapacity * 2, 16);
+		JournalRecord* pendingScores = (JournalRecord*)CountedRealloc(leaderboard->pendingScores, sizeof(JournalRecord) * capacity);
+		if (pendingScores == NULL)
+		{
+			printf("Ran out of memory when saving the score, it will be lost when the game is closed!\n");
+			return;
+		}
+		leaderboard->pendingScores = pendingScores;
+		leaderboard->pendingCapacity = capacity;
+	}
+	leaderboard->pendingScores[leaderboard->pendingCount] = record;
+	leaderboard->pendingCount++;
+}
+
+// map the highscore store and check that it isn't damaged
+// returns true when successful
+bool OpenHighscoreStore(Leaderboard* leaderboard, const char* filename)
+{
+	if (!MapFile(&leaderboard->store, filename, false))
+	{
+		printf("Couldn't open the highscores %s\n", filename);
+		return false;
 	}
+
+	const Uint8* data = leaderboard->store.data;
+	Sint64 size = leaderboard->store.size;
+	if (size < HIGHSCORES_HEADER_SIZE || memcmp(data, HIGHSCORES_MAGIC, 4) != 0 ||
+		SDL_SwapLE32(*(const Uint32*)(data + 4)) != HIGHSCORES_VERSION)
+	{
+		printf("%s is not a valid highscore file\n", filename);
+		return false;
+	}
+
+	int recordCount = (int)SDL_SwapLE32(*(const Uint32*)(data + 8));
+	Uint32 checksum = SDL_SwapLE32(*(const Uint32*)(data + 12));
+	const Highscore* records = (const Highscore*)(data + HIGHSCORES_HEADER_SIZE);
+	if (recordCount < 0 || size < HIGHSCORES_HEADER_SIZE + (Sint64)recordCount * HIGHSCORES_RECORD_SIZE ||
+		ChecksumHighscores(HIGHSCORES_CHECKSUM_SEED, records, recordCount) != checksum)
+	{
+		printf("%s is damaged, restore or delete it to start a new leaderboard\n", filename);
+		return false;
+	}
+
+	leaderboard->storedScores = records;
+	leaderboard->storedCount = recordCount;
+	leaderboard->scoreCount = recordCount;
+	return true;
+}
+
+bool LoadLeaderboard(Leaderboard* leaderboard)
+{
+	FILE* file = fopen(HIGHSCORES_FILE, "rb");
+	if (file != NULL)
+		fclose(file);
+	else if (!ImportTextHighscores(HIGHSCORES_FILE)) // first start with the binary store
+		return false;
+
+	if (!FoldHighscoreJournal(HIGHSCORES_FILE, HIGHSCORES_JOURNAL_FILE) ||
+		!OpenHighscoreStore(leaderboard, HIGHSCORES_FILE))
+		return false;
+
+	// without the writer the scores are still shown, they just aren't saved
+	leaderboard->writer = StartScoreWriter(HIGHSCORES_JOURNAL_FILE);
+
+	for (int mode = 0; mode < SORT_MODE_COUNT; mode++)
+	{
+		LeaderboardWindow* window = &leaderboard->windows[mode];
+		window->start = 0;
+		window->count = SelectHighscores(leaderboard, (LeaderboardSortMode)mode, NULL, true, window->rows, LEADERBOARD_WINDOW);
+	}
+	return BuildScoreRanking(leaderboard);
 }
 
 
 
 
 //////////////////////////////////////////////////////////////////////////////////////
-// SAVING
+// MERGING HIGHSCORES (--merge <output> <files...>)
 
-struct Highscore
+// highscores from the files are sorted in chunks of MERGE_CHUNK_RECORDS, every sorted chunk (a run)
+// is written to a temporary file and all runs are merged at the end, so memory use doesn't depend on the file sizes
+
+// reads a text or binary highscore file in pieces
+struct HighscoreReader
 {
-	int score;
-	int time; // in miliseconds
+	FILE* file = NULL;
+	bool binary = false;
+	int remaining = 0; // records left in a binary file
+	bool damaged = false; // the file ended early or a line isn't a number
 };
 
-enum LeaderboardSortMode
+bool OpenHighscoreReader(HighscoreReader* reader, const char* filename)
 {
-	SORT_BY_SCORE,
-	SORT_BY_TIME
-};
+	*reader = HighscoreReader();
+	reader->file = fopen(filename, "rb");
+	if (reader->file == NULL)
+	{
+		printf("Couldn't open %s\n", filename);
+		return false;
+	}
 
-struct Leaderboard
+	char magic[4] = {};
+	if (fread(magic, 1, 4, reader->file) == 4 && memcmp(magic, HIGHSCORES_MAGIC, 4) == 0)
+	{
+		if (ReadLE(reader->file, 4) != HIGHSCORES_VERSION)
+		{
+			printf("%s is not a valid highscore file\n", filename);
+			fclose(reader->file);
+			return false;
+		}
+		reader->binary = true;
+		reader->remaining = (int)ReadLE(reader->file, 4);
+		ReadLE(reader->file, 4); // the checksum isn't checked, damaged records are only a problem for the file itself
+	}
+	else
+		fseek(reader->file, 0, SEEK_SET);
+	return true;
+}
+
+// a line of a text highscore file, a number and nothing else
+// returns false when the line isn't a number
+bool ParseHighscoreNumber(const char* line, int* number)
 {
-	LeaderboardSortMode sortMode = SORT_BY_SCORE;
-	int displayOffset = 0;
-	double nextScrollTime = 0;
-	int arrayCapacity = 0;
-	int scoreCount = 0;
-	Highscore* highscores = NULL;
+	char* end = NULL;
+	long value = strtol(line, &end, 10);
+	if (end == line)
+		return false;
+	while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+		end++;
+	*number = (int)value;
+	return *end == '\0';
+}
+
+// returns the number of highscores read, 0 at the end of the file or when it's damaged
+int ReadHighscores(HighscoreReader* reader, Highscore* highscores, int maxCount)
+{
+	if (reader->binary)
+	{
+		int count = (int)fread(highscores, sizeof(Highscore), __min(maxCount, reader->remaining), reader->file);
+		if (count == 0 && reader->remaining > 0)
+			reader->damaged = true;
+		reader->remaining = count > 0 ? reader->remaining - count : 0;
+		return count;
+	}
+
+	// text format, score and time on separate lines
+	char stringBuffer[STRING_BUFFER_SIZE] = "";
+	int count = 0;
+	while (count < maxCount && fgets(stringBuffer, STRING_BUFFER_SIZE, reader->file))
+	{
+		if (stringBuffer[strspn(stringBuffer, " \t\r\n")] == '\0')
+			continue; // empty lines, e.g. at the end of the file
+
+		if (!ParseHighscoreNumber(stringBuffer, &highscores[count].score) ||
+			!fgets(stringBuffer, STRING_BUFFER_SIZE, reader->file) ||
+			!ParseHighscoreNumber(stringBuffer, &highscores[count].time))
+		{
+			reader->damaged = true;
+			return 0;
+		}
+		count++;
+	}
+	return count;
+}
+
+// the merged store is sorted by score and then by time, both from the highest
+// this puts duplicates next to each other
+int CompareHighscores(const void* a, const void* b)
+{
+	const Highscore* highscoreA = (const Highscore*)a;
+	const Highscore* highscoreB = (const Highscore*)b;
+	if (highscoreA->score != highscoreB->score)
+		return highscoreA->score > highscoreB->score ? -1 : 1;
+	if (highscoreA->time != highscoreB->time)
+		return highscoreA->time > highscoreB->time ? -1 : 1;
+	return 0;
+}
+
+// a sorted run in a temporary file, read through a small buffer
+struct MergeRun
+{
+	FILE* file;
+	Highscore buffer[MERGE_RUN_BUFFER];
+	int count;
+	int position;
 };
 
-void ScrollLeaderboard(Leaderboard* leaderboard, Input input, Time time)
+// returns false when the run has ended
+bool RefillMergeRun(MergeRun* run)
 {
-	if ((input.up || input.down) &&
-		time.time >= leaderboard->nextScrollTime)
+	if (run->position < run->count)
+		return true;
+	run->count = (int)fread(run->buffer, sizeof(Highscore), MERGE_RUN_BUFFER, run->file);
+	run->position = 0;
+	return run->count > 0;
+}
+
+// heap of run numbers, the run with the best next highscore is at the root
+void SiftMergeHeapDown(int* heap, int count, int i, MergeRun* runs)
+{
+	while (true)
 	{
-		leaderboard->nextScrollTime = time.time + LEADERBOARD_SCROLL_DELAY;
+		int best = i;
+		for (int child = i * 2 + 1; child <= i * 2 + 2 && child < count; child++)
+		{
+			MergeRun* childRun = &runs[heap[child]];
+			MergeRun* bestRun = &runs[heap[best]];
+			if (CompareHighscores(&childRun->buffer[childRun->position], &bestRun->buffer[bestRun->position]) < 0)
+				best = child;
+		}
+		if (best == i)
+			return;
 
-		if (input.up)
-			leaderboard->displayOffset--;
-		if (input.down)
-			leaderboard->displayOffset++;
+		int temp = heap[i];
+		heap[i] = heap[best];
+		heap[best] = temp;
+		i = best;
+	}
+}
 
+void GetMergeRunFilename(char* filename, const char* output, int run)
+{
+	snprintf(filename, STRING_BUFFER_SIZE, "%s.run%d", output, run);
+}
 
-		if (leaderboard->displayOffset > leaderboard->scoreCount - LEADERBOARD_LENGTH)
-			leaderboard->displayOffset = leaderboard->scoreCount - LEADERBOARD_LENGTH;
+// sort a chunk and write it as the given run
+bool WriteMergeRun(const char* output, int run, Highscore* chunk, int count)
+{
+	char filename[STRING_BUFFER_SIZE];
+	GetMergeRunFilename(filename, output, run);
+	qsort(chunk, count, sizeof(Highscore), CompareHighscores);
+
+	FILE* file = fopen(filename, "wb");
+	bool success = file != NULL && fwrite(chunk, sizeof(Highscore), count, file) == (size_t)count;
+	if (file != NULL) fclose(file);
+	if (!success)
+		printf("Couldn't write %s\n", filename);
+	return success;
+}
 
-		if (leaderboard->displayOffset < 0)
-			leaderboard->displayOffset = 0;
+void RemoveMergeRuns(const char* output, int runCount)
+{
+	char filename[STRING_BUFFER_SIZE];
+	for (int i = 0; i < runCount; i++)
+	{
+		GetMergeRunFilename(filename, output, i);
+		remove(filename);
 	}
 }
 
-void SortLeaderboard(Leaderboard* leaderboard)
+// sort the highscores from all files into runs, returns the number of runs or -1 on error
+// every file has to be read completely, a missing or damaged file fails the whole merge
+int WriteMergeRuns(const char* output, const char** files, int fileCount, int* recordCount)
 {
-	Highscore temp = {};
-	if (leaderboard->sortMode == SORT_BY_SCORE)
+	Highscore* chunk = (Highscore*)CountedMalloc(sizeof(Highscore) * MERGE_CHUNK_RECORDS);
+	if (chunk == NULL)
 	{
-		for (int i = 0; i < leaderboard->scoreCount - 1; i++)
-		{
-			for (int j = 0; j < leaderboard->scoreCount - i - 1; j++)
-			{
-				if (leaderboard->highscores[j].score < leaderboard->highscores[j + 1].score)
-				{
-					temp = leaderboard->highscores[j];
-					leaderboard->highscores[j] = leaderboard->highscores[j + 1];
-					leaderboard->highscores[j + 1] = temp;
-				}
-			}
-		}
+		printf("Ran out of memory when merging the highscores!\n");
+		return -1;
 	}
-	if (leaderboard->sortMode == SORT_BY_TIME)
+
+	int runCount = 0;
+	int count = 0; // a chunk can collect highscores from many small files
+	*recordCount = 0;
+	for (int i = 0; i < fileCount; i++)
 	{
-		for (int i = 0; i < leaderboard->scoreCount - 1; i++)
+		HighscoreReader reader;
+		if (!OpenHighscoreReader(&reader, files[i]))
 		{
-			for (int j = 0; j < leaderboard->scoreCount - i - 1; j++)
+			RemoveMergeRuns(output, runCount);
+			free(chunk);
+			return -1;
+		}
+
+		int read = 0;
+		int fileRecords = 0;
+		while ((read = ReadHighscores(&reader, chunk + count, MERGE_CHUNK_RECORDS - count)) > 0)
+		{
+			count += read;
+			fileRecords += read;
+			if (count < MERGE_CHUNK_RECORDS)
+				continue;
+
+			if (!WriteMergeRun(output, runCount, chunk, count))
 			{
-				if (leaderboard->highscores[j].time < leaderboard->highscores[j + 1].time)
-				{
-					temp = leaderboard->highscores[j];
-					leaderboard->highscores[j] = leaderboard->highscores[j + 1];
-					leaderboard->highscores[j + 1] = temp;
-				}
+				fclose(reader.file);
+				RemoveMergeRuns(output, runCount);
+				free(chunk);
+				return -1;
 			}
+			runCount++;
+			*recordCount += count;
+			count = 0;
+		}
+		fclose(reader.file);
+		if (reader.damaged)
+		{
+			printf("%s is damaged, nothing was merged\n", files[i]);
+			RemoveMergeRuns(output, runCount);
+			free(chunk);
+			return -1;
 		}
+		printf("Read %d highscores from %s\n", fileRecords, files[i]);
 	}
-}
 
-bool AddScoreToLeaderboard(Leaderboard* leaderboard, Highscore score)
-{
-	leaderboard->scoreCount++;
-	if (leaderboard->scoreCount > leaderboard->arrayCapacity)
+	// the last, partially filled chunk
+	if (count > 0)
 	{
-		leaderboard->arrayCapacity *= 2;
-		leaderboard->highscores = (Highscore*)realloc(leaderboard->highscores, sizeof(Highscore) * leaderboard->arrayCapacity);
-		if (leaderboard->highscores == NULL)
+		if (!WriteMergeRun(output, runCount, chunk, count))
 		{
-			printf("Ran out of memory when adding the highscore!\n");
-			return false;
+			RemoveMergeRuns(output, runCount);
+			runCount = -1;
+		}
+		else
+		{
+			runCount++;
+			*recordCount += count;
 		}
 	}
-	leaderboard->highscores[leaderboard->scoreCount - 1] = score;
-
-	return true;
-}
 
-void WriteIntToFile(int value, FILE* file, char* stringBuffer, const char* label)
-{
-	itoa(value, stringBuffer, 10);
-	fprintf(file, stringBuffer);
-	fprintf(file, " #");
-	fprintf(file, label);
-	fprintf(file, "\n");
+	free(chunk);
+	return runCount;
 }
 
-void SaveScore(Leaderboard* leaderboard, int score, double time)
+// k-way merge of the runs into a highscore store, duplicates are written only once
+// returns the number of written highscores or -1 on error
+int MergeRunsIntoStore(const char* output, int runCount)
 {
-	char stringBuffer[STRING_BUFFER_SIZE] = "";
-	FILE* file = fopen("highscores.txt", "a");
+	MergeRun* runs = (MergeRun*)CountedMalloc(sizeof(MergeRun) * __max(runCount, 1));
+	int* heap = (int*)CountedMalloc(sizeof(int) * __max(runCount, 1));
+	FILE* file = fopen(output, "wb");
+	if (runs == NULL || heap == NULL || file == NULL)
+	{
+		if (file == NULL)
+			printf("Couldn't open %s for writing the highscores\n", output);
+		else
+			printf("Ran out of memory when merging the highscores!\n");
+		if (file != NULL) fclose(file);
+		RemoveMergeRuns(output, runCount);
+		free(runs);
+		free(heap);
+		return -1;
+	}
 
-	Highscore highscore = { score, (int)(time * 1000) };
-	WriteIntToFile(highscore.score, file, stringBuffer, "score");
-	WriteIntToFile(highscore.time, file, stringBuffer, "time");
+	char filename[STRING_BUFFER_SIZE];
+	int heapCount = 0;
+	for (int i = 0; i < runCount; i++)
+	{
+		GetMergeRunFilename(filename, output, i);
+		runs[i].file = fopen(filename, "rb");
+		runs[i].count = 0;
+		runs[i].position = 0;
+		if (runs[i].file != NULL && RefillMergeRun(&runs[i]))
+			heap[heapCount++] = i;
+	}
+	for (int i = heapCount / 2 - 1; i >= 0; i--)
+		SiftMergeHeapDown(heap, heapCount, i, runs);
+
+	// the header is written again when the record count and the checksum are known
+	WriteHighscoreStoreHeader(file, 0, HIGHSCORES_CHECKSUM_SEED);
+	Uint32 checksum = HIGHSCORES_CHECKSUM_SEED;
+	int written = 0;
+	Highscore previous = {};
+	while (heapCount > 0)
+	{
+		MergeRun* run = &runs[heap[0]];
+		Highscore highscore = run->buffer[run->position];
+		run->position++;
 
-	fclose(file);
+		if (written == 0 || CompareHighscores(&highscore, &previous) != 0)
+		{
+			fwrite(&highscore, sizeof(Highscore), 1, file);
+			checksum = ChecksumHighscores(checksum, &highscore, 1);
+			previous = highscore;
+			written++;
+		}
 
-	AddScoreToLeaderboard(leaderboard, highscore);
-	SortLeaderboard(leaderboard);
-}
+		if (!RefillMergeRun(run))
+			heap[0] = heap[--heapCount];
+		SiftMergeHeapDown(heap, heapCount, 0, runs);
+	}
 
-bool LoadLeaderboard(Leaderboard* leaderboard)
-{
-	leaderboard->arrayCapacity = 1;
-	leaderboard->highscores = (Highscore*)malloc(sizeof(Highscore));
+	fseek(file, 0, SEEK_SET);
+	WriteHighscoreStoreHeader(file, written, checksum);
+	bool success = !ferror(file);
+	fclose(file);
 
-	char stringBuffer[STRING_BUFFER_SIZE] = "";
-	FILE* file = fopen(HIGHSCORES_FILE, "r");
-	if (file == NULL) // file doesn't exist
+	for (int i = 0; i < runCount; i++)
 	{
-		file = fopen(HIGHSCORES_FILE, "w");
-		file = freopen(HIGHSCORES_FILE, "r", file);
+		if (runs[i].file != NULL) fclose(runs[i].file);
 	}
+	RemoveMergeRuns(output, runCount);
+	free(runs);
+	free(heap);
 
-	while (fgets(stringBuffer, STRING_BUFFER_SIZE, file))
+	if (!success)
 	{
-		Highscore highscore = {};
-		highscore.score = atoi(stringBuffer);
-		fgets(stringBuffer, STRING_BUFFER_SIZE, file);
-		highscore.time = atoi(stringBuffer);
+		printf("Error while writing the highscores to %s\n", output);
+		return -1;
+	}
+	return written;
+}
 
-		if (!AddScoreToLeaderboard(leaderboard, highscore))
-			return false;
+// the output is opened only after all files were read, so it can be one of them
+bool MergeHighscoreFiles(const char* output, const char** files, int fileCount)
+{
+	// scores in the journal are numbered by their position in HIGHSCORES_FILE, rewriting the store
+	// would change those positions and the scores would be lost, so they're added to it first
+	if (!FoldHighscoreJournal(HIGHSCORES_FILE, HIGHSCORES_JOURNAL_FILE))
+	{
+		printf("Couldn't save the scores from %s, nothing was merged\n", HIGHSCORES_JOURNAL_FILE);
+		return false;
 	}
 
-	fclose(file);
+	int recordCount = 0;
+	int runCount = WriteMergeRuns(output, files, fileCount, &recordCount);
+	if (runCount < 0)
+		return false;
 
-	SortLeaderboard(leaderboard);
+	int written = MergeRunsIntoStore(output, runCount);
+	if (written < 0)
+		return false;
 
+	printf("Merged %d highscores into %s (%d duplicates removed)\n", written, output, recordCount - written);
 	return true;
 }
 
@@ -1388,101 +4886,388 @@ bool LoadLeaderboard(Leaderboard* leaderboard)
 //////////////////////////////////////////////////////////////////////////////////////
 // GAME VISUALS
 
-void DrawGameObjects(SDL_Surface* screen, GameData* gameData)
+// the road is drawn one screen row at a time, as a span of grass, asphalt and grass again
+// the edges come from the road profile, so every pixel is written once and the bends are smooth
+void DrawRoad(Canvas* canvas, GameData* gameData, double alpha)
 {
-	gameData->background->Draw(screen);
-	for (int i = 0; i < ROAD_EDGE_SEGMENTS * 2; i++)
+	SDL_Surface* asphalt = gameData->background->sprite;
+	SDL_Surface* grass = gameData->grassSprite;
+	if (asphalt == NULL || grass == NULL)
+		return;
+
+	Player* player = gameData->player;
+	double distance = player->previousDistanceCounter + (player->distanceCounter - player->previousDistanceCounter) * alpha;
+	// the asphalt texture is centered on the background object, the same as other sprites
+	GameObject* background = gameData->background;
+	int asphaltTop = (int)Lerp(background->previousPosition, background->position, alpha).y - asphalt->h / 2;
+	// the grass moves together with the road
+	int grassTop = (int)floor(distance);
+
+	for (int y = 0; y < canvas->h; y++)
 	{
-		gameData->roadEdgeSegments[i]->Draw(screen);
+		RoadEdges edges = GetRoadEdges(&gameData->road, distance - y);
+		int left = (int)Clamp(round(edges.left), 0, canvas->w);
+		int right = (int)Clamp(round(edges.right), left, canvas->w);
+
+		DrawSpan(canvas, grass, 0, y - grassTop, 0, y, left);
+		DrawSpan(canvas, asphalt, left, y - asphaltTop, left, y, right - left);
+		DrawSpan(canvas, grass, right, y - grassTop, right, y, canvas->w - right);
 	}
-	gameData->player->Draw(screen);
-	gameData->riflePowerup->Draw(screen);
+}
 
-	for (int i = 0; i < gameData->npcCount; i++)
+void DrawNPCs(Canvas* canvas, GameData* gameData, Time time)
+{
+	NPCStore* npcs = &gameData->npcs;
+	for (int i = 0; i < npcs->count; i++)
 	{
-		gameData->npcs[i]->Draw(screen);
+		SDL_Surface* sprite = GetNPCSprite(&gameData->npcArchetypes[npcs->type[i]], npcs->deathTime[i], time.gametime);
+		Vector2 pos = Lerp(npcs->previousPosition[i], npcs->position[i], time.alpha);
+		DrawSurface(canvas, sprite, pos.x, pos.y);
 	}
+}
 
-	for (int i = 0; i < MAX_BULLETS; i++)
+void DrawGameObjects(Canvas* canvas, GameData* gameData, Time time)
+{
+	double alpha = time.alpha;
+
+	DrawRoad(canvas, gameData, alpha);
+	gameData->player->Draw(canvas, alpha);
+	gameData->riflePowerup->Draw(canvas, alpha);
+
+	DrawNPCs(canvas, gameData, time);
+
+	BulletStore* bullets = &gameData->bullets;
+	for (int i = 0; i < bullets->count; i++)
 	{
-		gameData->bullets[i]->Draw(screen);
+		Vector2 pos = Lerp(bullets->previousPosition[i], bullets->position[i], alpha);
+		DrawSurface(canvas, gameData->bulletSprite, pos.x, pos.y);
 	}
 }
 
-void DrawLeaderboard(SDL_Surface* screen, Leaderboard leaderboard, SDL_Surface* charset, char* stringBuffer)
+void DrawLeaderboard(Canvas* canvas, Leaderboard* leaderboard, TextCache* text, char* stringBuffer)
 {
-	if (leaderboard.scoreCount == 0) return;
+	if (leaderboard->scoreCount == 0) return;
 
-	DrawString(screen, { 5,-90 }, "Highscores:", charset, MIDDLE_LEFT);
-	if (leaderboard.sortMode == SORT_BY_SCORE)
-		DrawString(screen, { 5,-78 }, "(Sorted by score)", charset, MIDDLE_LEFT);
+	DrawCachedString(canvas, text, { 5,-90 }, "Highscores:", MIDDLE_LEFT);
+	if (leaderboard->sortMode == SORT_BY_SCORE)
+		DrawCachedString(canvas, text, { 5,-78 }, "(Sorted by score)", MIDDLE_LEFT);
 	else
-		DrawString(screen, { 5,-78 }, "(Sorted by time)", charset, MIDDLE_LEFT);
-	DrawString(screen, { 2,-65 }, "       Time  Score", charset, MIDDLE_LEFT);
+		DrawCachedString(canvas, text, { 5,-78 }, "(Sorted by time)", MIDDLE_LEFT);
+	DrawCachedString(canvas, text, { 2,-65 }, "       Time  Score", MIDDLE_LEFT);
 	for (int i = 0; 
 		i < LEADERBOARD_LENGTH &&
-		i + leaderboard.displayOffset < leaderboard.scoreCount;
+		i + leaderboard->displayOffset < leaderboard->scoreCount;
 		i++)
 	{
-		int index = i + leaderboard.displayOffset;
-		sprintf(stringBuffer, "%3d.%7.2f %6.0d", index + 1, leaderboard.highscores[index].time * 0.001, leaderboard.highscores[index].score);
-		DrawString(screen, { 2,(double)(-50 + i * 10) }, stringBuffer, charset, MIDDLE_LEFT);
+		int index = i + leaderboard->displayOffset;
+		Highscore highscore = GetLeaderboardRow(leaderboard, index);
+
+		// "%3d.%7.2f %6.0d", a score of 0 is left blank
+		int length = FormatInteger(stringBuffer, index + 1, 3);
+		stringBuffer[length++] = '.';
+		length += FormatFixed(stringBuffer + length, highscore.time * 0.001, 2, 7);
+		stringBuffer[length++] = ' ';
+		if (highscore.score != 0)
+			FormatInteger(stringBuffer + length, highscore.score, 6);
+		else
+			CopyText(stringBuffer + length, "      ");
+		DrawCachedString(canvas, text, { 2,(double)(-50 + i * 10) }, stringBuffer, MIDDLE_LEFT);
 	}
 }
-void DrawUI(SDL_Surface* screen, GameData* gameData, Time time, Leaderboard leaderboard, SDL_Surface* charset, char* stringBuffer)
+void DrawUI(Canvas* canvas, GameData* gameData, Time time, Leaderboard* leaderboard, TextCache* text, char* stringBuffer)
 {
-	DrawString(screen, { 0,10 }, WINDOW_TITLE, charset, UPPER_CENTER);
-	DrawString(screen, { -5,-5 }, "ABCDEFIJKLM", charset, LOWER_RIGHT);
+	DrawCachedString(canvas, text, { 0,10 }, WINDOW_TITLE, UPPER_CENTER);
+	DrawCachedString(canvas, text, { -5,-5 }, "ABCDEFIJKLM", LOWER_RIGHT);
 
 
 	if (!IsGameOver(gameData))
 	{
-		sprintf(stringBuffer, "Time: %.2f Score: %d", time.gametime, gameData->player->score);
-		DrawString(screen, { 0,30 }, stringBuffer, charset, UPPER_CENTER);
+		// "Time: %.2f Score: %d", the time changes every frame so only it is drawn character by character
+		const char* timeLabel = "Time: ";
+		char timeText[STRING_BUFFER_SIZE];
+		int timeLength = FormatFixed(timeText, time.gametime, 2, 0);
+		FormatLabel(stringBuffer, " Score: ", gameData->player->score);
+		SDL_Point position = GetTextPosition(canvas, { 0,30 },
+			(int)strlen(timeLabel) + timeLength + (int)strlen(stringBuffer), UPPER_CENTER);
+		DrawCachedStringAt(canvas, text, position.x, position.y, timeLabel);
+		position.x += (int)strlen(timeLabel) * 8;
+		DrawGlyphs(canvas, position.x, position.y, timeText, text->charset);
+		position.x += timeLength * 8;
+		DrawCachedStringAt(canvas, text, position.x, position.y, stringBuffer);
 
 		if (time.gametime >= INFINITE_LIVES_DURATION)
-		{
-			sprintf(stringBuffer, "Lives: %d", gameData->player->lives);
-			DrawString(screen, { 0,50 }, stringBuffer, charset, UPPER_CENTER);
-		}
+			DrawCachedString(canvas, text, { 0,50 }, FormatLabel(stringBuffer, "Lives: ", gameData->player->lives), UPPER_CENTER);
 		else
-			DrawString(screen, { 0,50 }, "Lives: INFINITE", charset, UPPER_CENTER);
+			DrawCachedString(canvas, text, { 0,50 }, "Lives: INFINITE", UPPER_CENTER);
+
+		int rank = GetScoreRank(leaderboard, gameData->player->score);
+		int percent = (int)ceil(rank * 100.0 / (leaderboard->scoreCount + 1));
+		int length = CopyText(stringBuffer, "Rank ");
+		length += FormatInteger(stringBuffer + length, rank, 0);
+		length += CopyText(stringBuffer + length, " / top ");
+		length += FormatInteger(stringBuffer + length, percent, 0);
+		CopyText(stringBuffer + length, "%");
+		DrawCachedString(canvas, text, { 0,70 }, stringBuffer, UPPER_CENTER);
 
 		if (gameData->player->scorePenalty > time.gametime)
-			DrawString(screen, { 0,-20 }, "No points!", charset, LOWER_CENTER);
+			DrawCachedString(canvas, text, { 0,-20 }, "No points!", LOWER_CENTER);
 
 		if (gameData->player->rifleAmmo > 0)
-		{
-			sprintf(stringBuffer, "AMMO: %d", gameData->player->rifleAmmo);
-			DrawString(screen, { -30,0 }, stringBuffer, charset, MIDDLE_RIGHT);
-		}
+			DrawCachedString(canvas, text, { -30,0 }, FormatLabel(stringBuffer, "AMMO: ", gameData->player->rifleAmmo), MIDDLE_RIGHT);
 	}
 	else
 	{
-		DrawString(screen, { 0,-40 }, "GAME OVER", charset, CENTER);
+		DrawCachedString(canvas, text, { 0,-40 }, "GAME OVER", CENTER);
 
-		sprintf(stringBuffer, "Score: %d", gameData->player->score);
-		DrawString(screen, { 0,-20 }, stringBuffer, charset, CENTER);
+		DrawCachedString(canvas, text, { 0,-20 }, FormatLabel(stringBuffer, "Score: ", gameData->player->score), CENTER);
 
-		sprintf(stringBuffer, "Time: %.2f", gameData->gameOverTime);
-		DrawString(screen, { 0,0 }, stringBuffer, charset, CENTER);
+		int length = CopyText(stringBuffer, "Time: ");
+		FormatFixed(stringBuffer + length, gameData->gameOverTime, 2, 0);
+		DrawCachedString(canvas, text, { 0,0 }, stringBuffer, CENTER);
 
 
-		DrawString(screen, { 0,-40 }, "N - new game  ", charset, LOWER_CENTER);
-		DrawString(screen, { 0,-25 }, "S - save score", charset, LOWER_CENTER);
+		DrawCachedString(canvas, text, { 0,-40 }, "N - new game  ", LOWER_CENTER);
+		DrawCachedString(canvas, text, { 0,-25 }, "S - save score", LOWER_CENTER);
 	}
 
 	if (time.paused || IsGameOver(gameData))
 	{
-		DrawLeaderboard(screen, leaderboard, charset, stringBuffer);
+		DrawLeaderboard(canvas, leaderboard, text, stringBuffer);
+	}
+}
+
+// colors of the stages in the profiler graph
+const Uint8 PROFILER_STAGE_COLORS[STAGE_COUNT][3] = {
+	{ 0x30, 0x90, 0xFF },
+	{ 0xFF, 0x50, 0x50 },
+	{ 0xFF, 0xE0, 0x40 },
+	{ 0xFF, 0x90, 0x20 },
+	{ 0xB0, 0x60, 0xFF },
+	{ 0x40, 0xD0, 0x60 },
+	{ 0x40, 0xE0, 0xE0 },
+	{ 0x90, 0xD0, 0x30 },
+	{ 0xA0, 0x70, 0x40 },
+	{ 0xFF, 0x70, 0xD0 },
+	{ 0xC0, 0xC0, 0xC0 },
+};
+
+// a table with min/avg/p99 of every stage and a stacked bar graph of the frame times
+void DrawProfiler(Canvas* canvas, Profiler* profiler, SDL_Surface* charset, char* stringBuffer)
+{
+	DrawString(canvas, { -5,22 }, "ms             min   avg   p99", charset, UPPER_RIGHT);
+	for (int i = 0; i <= STAGE_COUNT; i++)
+	{
+		StageStats stats = CalculateStageStats(profiler, i);
+		const char* name = i < STAGE_COUNT ? PROFILER_STAGE_NAMES[i] : "Total";
+		sprintf(stringBuffer, "%-12s%6.2f%6.2f%6.2f", name, stats.min * 1000, stats.avg * 1000, stats.p99 * 1000);
+		DrawString(canvas, { -5,(double)(34 + i * 10) }, stringBuffer, charset, UPPER_RIGHT);
+
+		if (i < STAGE_COUNT)
+		{
+			int x = canvas->w - 5 - (int)strlen(stringBuffer) * 8 - 10;
+			FillRectangle(canvas, { x, 34 + i * 10, 8, 8 },
+				PROFILER_STAGE_COLORS[i][0], PROFILER_STAGE_COLORS[i][1], PROFILER_STAGE_COLORS[i][2]);
+		}
+	}
+
+	// one column per frame, the newest frame is on the right
+	int bottom = canvas->h - 5;
+	FillRectangle(canvas, { 5, bottom - PROFILER_GRAPH_HEIGHT, PROFILER_HISTORY, PROFILER_GRAPH_HEIGHT }, 0x10, 0x10, 0x10);
+	for (int frame = 0; frame < profiler->historyCount; frame++)
+	{
+		int x = 5 + PROFILER_HISTORY - profiler->historyCount + frame;
+		int y = bottom;
+		for (int i = 0; i < STAGE_COUNT && y > bottom - PROFILER_GRAPH_HEIGHT; i++)
+		{
+			int height = (int)(GetProfiledTime(profiler, frame, i) * 1000 / PROFILER_GRAPH_MS * PROFILER_GRAPH_HEIGHT + 0.5);
+			height = __min(height, y - (bottom - PROFILER_GRAPH_HEIGHT));
+			if (height <= 0) continue;
+			y -= height;
+			FillRectangle(canvas, { x, y, 1, height },
+				PROFILER_STAGE_COLORS[i][0], PROFILER_STAGE_COLORS[i][1], PROFILER_STAGE_COLORS[i][2]);
+		}
 	}
+	sprintf(stringBuffer, "%.0f ms", PROFILER_GRAPH_MS);
+	DrawString(canvas, { 5,(double)(-5 - PROFILER_GRAPH_HEIGHT - 10) }, stringBuffer, charset, LOWER_LEFT);
 }
 
-void DrawDebugInfo(SDL_Surface* screen, GameData* gameData, Time time, SDL_Surface* charset, char* stringBuffer)
+void DrawDebugInfo(Canvas* canvas, GameData* gameData, Time time, Profiler* profiler, SDL_Surface* charset, char* stringBuffer)
 {
-	//DrawRectangle(screen, 4, 4, SCREEN_WIDTH - 8, 36, red, blue);
+	//DrawRectangle(canvas, 4, 4, SCREEN_WIDTH - 8, 36, red, blue);
 	sprintf(stringBuffer, "FPS: %.0lf ", time.fps);
-	DrawString(screen, { 0,10 }, stringBuffer, charset, UPPER_RIGHT);
+	DrawString(canvas, { 0,10 }, stringBuffer, charset, UPPER_RIGHT);
+
+	DrawProfiler(canvas, profiler, charset, stringBuffer);
+
+	// the bandwidth a locked frame saves
+	double copiedBytes = GetAverageCopiedBytes(profiler);
+	sprintf(stringBuffer, "Frame copy: %.2f MB/frame %4.0f MB/s", copiedBytes / 1048576, copiedBytes * time.fps / 1048576);
+	DrawString(canvas, { -5,(double)(34 + (STAGE_COUNT + 1) * 10 + 4) }, stringBuffer, charset, UPPER_RIGHT);
+}
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+// HEADLESS SIMULATION
+
+// generates input for a simple bot that holds the gas, keeps shooting
+// and steers towards the middle of the road
+void SyntheticInput(Input* input, GameData* gameData)
+{
+	Player* player = gameData->player;
+	double distance = player->distanceCounter - player->position.y;
+	RoadEdges edges = GetRoadEdges(&gameData->road, distance);
+	double roadCenter = (edges.left + edges.right) * 0.5;
+
+	*input = {};
+	input->up = true;
+	input->shoot = true;
+	input->left = player->position.x > roadCenter + NPC_EDGE_DISTANCE / 2;
+	input->right = player->position.x < roadCenter - NPC_EDGE_DISTANCE / 2;
+}
+
+// keeps at least npcTarget NPCs on the screen, used to stress test the simulation
+// the extra cars use their own generator, so the normal spawning isn't affected
+void StressSpawning(GameData* gameData, Random* random, int npcTarget)
+{
+	while (gameData->npcs.count < npcTarget)
+	{
+		double y = RandRange(random, -OBJECT_SPAWN_MARGIN, SCREEN_HEIGHT);
+		double distance = gameData->player->distanceCounter - y;
+		RoadEdges edges = GetRoadEdges(&gameData->road, distance);
+		Vector2 pos = { RandRange(random, edges.left, edges.right), y };
+		if (!CreateNPC(gameData, pos, RandVal(random) < 0.5 ? ENEMY : CIVILIAN))
+			return;
+	}
+}
+
+// runs the game logic for the given number of ticks with a fixed delta,
+// without creating a window or drawing anything
+// a new game is started every time the previous one ends
+// every new game uses the next seed after the previous one
+// when recordPrefix isn't NULL, the games are saved as replays
+// when stressNPCs is above 0, that many NPCs are kept alive at all times
+void RunHeadless(int ticks, Uint64 seed, const char* recordPrefix, int stressNPCs)
+{
+	// sprites are only needed for drawing, so GameObjects can keep NULL pointers
+	SDL_Surface* bitmaps[BMP_COUNT] = {};
+
+	printf("Headless run with seed %llu\n", (unsigned long long)seed);
+
+	if (stressNPCs > 0 && recordPrefix != NULL)
+	{
+		// replays don't store the extra cars, so they couldn't be played back
+		printf("Stress runs can't be recorded, --record is ignored\n");
+		recordPrefix = NULL;
+	}
+
+	Arena arena;
+	if (!CreateArena(&arena, GAME_ARENA_SIZE))
+		return;
+
+	Replay recording;
+	ResetReplay(&recording, seed);
+
+	Time time = {};
+	Input input = {};
+	GameData gameData;
+	CreateGameObjects(&gameData, &arena);
+	ResetGame(&gameData, bitmaps, seed++);
+	int gamesPlayed = 1;
+
+	Uint64 startCounter = SDL_GetPerformanceCounter();
+
+	for (int tick = 0; tick < ticks; tick++)
+	{
+		AdvanceTick(&time);
+		time.time = time.gametime;
+
+		if (stressNPCs > 0)
+			StressSpawning(&gameData, &gameData.random[RNG_STRESS], stressNPCs);
+
+		SyntheticInput(&input, &gameData);
+		if (recordPrefix != NULL)
+			RecordReplayInput(&recording, &input);
+		GameUpdate(time, &gameData, bitmaps, &input, NULL);
+
+		if (IsGameOver(&gameData))
+		{
+			if (recordPrefix != NULL)
+			{
+				printf("Game %d state hash: %016llx\n", gamesPlayed, (unsigned long long)HashGameState(&gameData));
+				SaveRecordedGame(&recording, recordPrefix, gamesPlayed);
+				ResetReplay(&recording, seed);
+			}
+
+			ResetGame(&gameData, bitmaps, seed++);
+			time = {};
+			gamesPlayed++;
+		}
+	}
+
+	double elapsed = (double)(SDL_GetPerformanceCounter() - startCounter) / (double)SDL_GetPerformanceFrequency();
+
+	if (recordPrefix != NULL && recording.tickCount > 0)
+	{
+		printf("Game %d state hash: %016llx\n", gamesPlayed, (unsigned long long)HashGameState(&gameData));
+		SaveRecordedGame(&recording, recordPrefix, gamesPlayed);
+	}
+
+	FreeGameMemory(&gameData);
+	FreeArena(&arena);
+	FreeReplay(&recording);
+
+	printf("Headless run: %d ticks, %d games in %.3f s\n", ticks, gamesPlayed, elapsed);
+	printf("Ticks per second: %.0f\n", elapsed > 0 ? ticks / elapsed : 0.0);
+}
+
+// plays back a recorded game without a window
+// prints the final state hash, which is identical for every playback of the same file
+bool RunReplay(const char* filename)
+{
+	Replay replay;
+	if (!LoadReplay(&replay, filename))
+	{
+		FreeReplay(&replay);
+		return false;
+	}
+
+	SDL_Surface* bitmaps[BMP_COUNT] = {};
+
+	Arena arena;
+	if (!CreateArena(&arena, GAME_ARENA_SIZE))
+	{
+		FreeReplay(&replay);
+		return false;
+	}
+
+	Time time = {};
+	Input input = {};
+	GameData gameData;
+	CreateGameObjects(&gameData, &arena);
+	ResetGame(&gameData, bitmaps, replay.seed);
+
+	Uint64 startCounter = SDL_GetPerformanceCounter();
+
+	while (PlayReplayInput(&replay, &input))
+	{
+		AdvanceTick(&time);
+		time.time = time.gametime;
+		GameUpdate(time, &gameData, bitmaps, &input, NULL);
+	}
+
+	double elapsed = (double)(SDL_GetPerformanceCounter() - startCounter) / (double)SDL_GetPerformanceFrequency();
+
+	printf("Replay %s: seed %llu, %lld ticks, score %d\n", filename, (unsigned long long)replay.seed, time.ticks, gameData.player->score);
+	printf("State hash: %016llx\n", (unsigned long long)HashGameState(&gameData));
+	printf("Ticks per second: %.0f\n", elapsed > 0 ? time.ticks / elapsed : 0.0);
+
+	FreeGameMemory(&gameData);
+	FreeArena(&arena);
+	FreeReplay(&replay);
+	return true;
 }
 
 
@@ -1498,7 +5283,119 @@ extern "C"
 int main(int argc, char** argv)
 {
 	printf("printf output goes here:\n");
-	srand(time(NULL));
+
+	// command line options:
+	// --headless [ticks]  run the simulation without a window
+	// --npcs <count>      keep this many NPCs alive in a headless run (stress test)
+	// --seed <seed>       seed of the first game, the following games use the next seeds
+	// --record <prefix>   save every game as <prefix>_<game number>.rpl
+	// --replay <file>     play back a recorded game without a window
+	// --renderer <mode>   "surface" (default), "locked" (surface drawn straight into the texture) or "texture", see RenderMode
+	// --software-renderer use SDL's software renderer
+	// --blit-report       print how long blitting every sprite takes before and after it's prepared for RENDER_SURFACE
+	// --fps-limit <fps>   override FPS_LIMIT, -1 means unlimited
+	// --trace <file>      write a chrome://tracing timeline of every frame when the game exits
+	// --merge <output> <files...>  merge text or binary highscore files into one sorted store and exit
+	// --pack-atlas <archive> [files...]  pack bitmaps (all sprites by default) into a sprite atlas and exit
+	bool headless = false;
+	int headlessTicks = HEADLESS_DEFAULT_TICKS;
+	Uint64 seed = (Uint64)time(NULL);
+	const char* recordPrefix = NULL;
+	const char* replayFile = NULL;
+	int stressNPCs = 0;
+	RenderMode renderMode = RENDER_SURFACE;
+	bool lockFrame = false;
+	bool softwareRenderer = false;
+	bool blitReport = false;
+	int fpsLimit = FPS_LIMIT;
+	const char* traceFile = NULL;
+	const char* mergeOutput = NULL;
+	const char** mergeFiles = NULL;
+	int mergeFileCount = 0;
+	const char* atlasOutput = NULL;
+	const char** atlasFiles = NULL;
+	int atlasFileCount = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				headlessTicks = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPrefix = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "--npcs") == 0 && i + 1 < argc)
+			stressNPCs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "texture") == 0)
+				renderMode = RENDER_TEXTURE;
+			else if (strcmp(argv[i], "surface") == 0)
+				renderMode = RENDER_SURFACE;
+			else if (strcmp(argv[i], "locked") == 0)
+			{
+				renderMode = RENDER_SURFACE;
+				lockFrame = true;
+			}
+			else
+				printf("Unknown renderer: %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--software-renderer") == 0)
+			softwareRenderer = true;
+		else if (strcmp(argv[i], "--blit-report") == 0)
+			blitReport = true;
+		else if (strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc)
+			fpsLimit = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			traceFile = argv[++i];
+		else if (strcmp(argv[i], "--merge") == 0 && i + 1 < argc)
+		{
+			// all remaining arguments are the merged files
+			mergeOutput = argv[++i];
+			mergeFiles = (const char**)&argv[i + 1];
+			mergeFileCount = argc - i - 1;
+			break;
+		}
+		else if (strcmp(argv[i], "--pack-atlas") == 0 && i + 1 < argc)
+		{
+			// all remaining arguments are the packed bitmaps
+			atlasOutput = argv[++i];
+			atlasFiles = (const char**)&argv[i + 1];
+			atlasFileCount = argc - i - 1;
+			break;
+		}
+		else
+			printf("Unknown option: %s\n", argv[i]);
+	}
+
+	if (mergeOutput != NULL)
+		return MergeHighscoreFiles(mergeOutput, mergeFiles, mergeFileCount) ? 0 : 1;
+
+	if (atlasOutput != NULL)
+	{
+		const char* spriteFiles[] = SPRITE_ATLAS_FILES;
+		if (atlasFileCount == 0)
+		{
+			atlasFiles = spriteFiles;
+			atlasFileCount = sizeof(spriteFiles) / sizeof(spriteFiles[0]);
+		}
+		return PackSpriteAtlas(atlasOutput, atlasFiles, atlasFileCount) ? 0 : 1;
+	}
+
+	if (replayFile != NULL)
+		return RunReplay(replayFile) ? 0 : 1;
+
+	if (headless)
+	{
+		RunHeadless(headlessTicks, seed, recordPrefix, stressNPCs);
+		return 0;
+	}
 
 	char stringBuffer[STRING_BUFFER_SIZE] = {};
 	int quit = 0;
@@ -1510,7 +5407,8 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
-	SDL_Surface* bitmaps[BMP_COUNT];
+	SpriteAtlas atlas;
+	SDL_Surface* bitmaps[BMP_COUNT] = {};
 
 
 	SDL_Event event;
@@ -1519,20 +5417,48 @@ int main(int argc, char** argv)
 	SDL_Window* window = NULL;
 	SDL_Renderer* renderer = NULL;
 
-	if (!InitialiseSDL(&window, &renderer, &screen, &scrtex))
+	if (!InitialiseSDL(&window, &renderer, &screen, &scrtex, softwareRenderer))
 		return 1;
 
-	if (!LoadAllBitmaps(bitmaps))
+	if (!LoadAllBitmaps(&atlas, bitmaps) ||
+		(renderMode == RENDER_TEXTURE && !CreateBitmapTextures(renderer, &atlas, bitmaps)) ||
+		(renderMode == RENDER_SURFACE && !PrepareBitmaps(bitmaps, screen, blitReport)))
 	{
-		FreeBitmaps(bitmaps);
+		FreeBitmaps(&atlas, bitmaps);
 		return 1;
 	}
 
+	Canvas canvas = { renderMode, screen, renderer, SCREEN_WIDTH, SCREEN_HEIGHT, NULL };
+	TextCache textCache;
+	textCache.charset = bitmaps[BMP_CHARSET];
+	LockedFrame lockedFrame;
+	lockedFrame.texture = scrtex;
+
+	// every frame is recorded first, only the parts that differ from the previous frame are drawn
+	DrawList drawLists[2];
+	DrawList* frameList = &drawLists[0];
+	DrawList* previousList = &drawLists[1];
+	bool redrawAll = true;
+
 	int black = SDL_MapRGB(screen->format, 0x00, 0x00, 0x00);
 	int red = SDL_MapRGB(screen->format, 0xFF, 0x00, 0x00);
 	int green = SDL_MapRGB(screen->format, 0x00, 0xFF, 0x00);
 	int blue = SDL_MapRGB(screen->format, 0x11, 0x11, 0xCC);
 
+	Replay recording;
+	int gameNumber = 0;
+
+	// every game reuses the same objects
+	Arena arena;
+	if (!CreateArena(&arena, GAME_ARENA_SIZE))
+		return 1;
+	GameData gameData;
+	CreateGameObjects(&gameData, &arena);
+
+	Profiler profiler;
+	if (traceFile != NULL)
+		StartTracing(&profiler);
+
 	// this loop is repeated when the player starts a new game
 	while (!quit)
 	{
@@ -1540,8 +5466,10 @@ int main(int argc, char** argv)
 		Input input = {};
 		bool scoreSaved = false; // this is to prevent saving the score multiple times
 
-		GameData gameData;
-		GameStart(&gameData, bitmaps);
+		gameNumber++;
+		ResetReplay(&recording, seed);
+
+		ResetGame(&gameData, bitmaps, seed++);
 
 		// reset the tick counter so that the time delta 
 		// in the first frame doesn't take into account time spent loading the game
@@ -1552,24 +5480,67 @@ int main(int argc, char** argv)
 		while (!quit && !input.newGame)
 		{
 			MeasureTime(&time);
+			RunSimulation(&time, &gameData, bitmaps, &input, recordPrefix != NULL ? &recording : NULL, &profiler);
 
-			if (!time.paused)
-				GameUpdate(time, &gameData, bitmaps, &input);
-
-			DrawGameObjects(screen, &gameData);
-			DrawUI(screen, &gameData, time, leaderboard, bitmaps[BMP_CHARSET], stringBuffer);
+			ClearDrawList(frameList);
+			canvas.list = frameList;
+			{
+				ProfileScope scope(&profiler, STAGE_DRAW_GAME_OBJECTS);
+				DrawGameObjects(&canvas, &gameData, time);
+			}
+			{
+				ProfileScope scope(&profiler, STAGE_DRAW_UI);
+				DrawUI(&canvas, &gameData, time, &leaderboard, &textCache, stringBuffer);
+			}
 
 			if (input.showDebug)
-				DrawDebugInfo(screen, &gameData, time, bitmaps[BMP_CHARSET], stringBuffer);
-
-			if (input.switchScoreSorting)
+				DrawDebugInfo(&canvas, &gameData, time, &profiler, bitmaps[BMP_CHARSET], stringBuffer);
+			canvas.list = NULL;
+
+			SDL_Rect screenRect = { 0, 0, canvas.w, canvas.h };
+			SDL_Rect dirtyRects[DIRTY_RECT_LIMIT];
+			int dirtyCount = 1;
+			dirtyRects[0] = screenRect;
+			if (!redrawAll && !frameList->failed && !previousList->failed)
+				dirtyCount = FindDirtyRects(&canvas, frameList, previousList, dirtyRects);
+			redrawAll = false;
+
+			if (dirtyCount > 0 && lockFrame)
+			{
+				ProfileScope scope(&profiler, STAGE_FRAME_COPY);
+				if (!LockFrame(&lockedFrame, &canvas))
+				{
+					printf("Couldn't lock the screen texture, the frame is copied to it again\n");
+					lockFrame = false;
+					canvas.screen = screen;
+					dirtyCount = 1;
+					dirtyRects[0] = screenRect;
+				}
+			}
+			if (dirtyCount > 0)
 			{
-				if (leaderboard.sortMode == SORT_BY_SCORE)
-					leaderboard.sortMode = SORT_BY_TIME;
+				ProfileScope scope(&profiler, STAGE_REDRAW);
+				// the renderer's frame and the locked pixels aren't kept, they're always drawn whole
+				if (canvas.mode == RENDER_TEXTURE)
+				{
+					SDL_RenderClear(renderer);
+					ReplayDrawList(&canvas, frameList, NULL);
+				}
+				else if (lockFrame)
+					ReplayDrawList(&canvas, frameList, NULL);
 				else
-					leaderboard.sortMode = SORT_BY_SCORE;
+				{
+					for (int i = 0; i < dirtyCount; i++)
+						ReplayDrawList(&canvas, frameList, &dirtyRects[i]);
+				}
+			}
 
-				SortLeaderboard(&leaderboard);
+			// the pause, the sorting and the saving change what the next frame shows
+			bool inputHandled = input.pause || input.switchScoreSorting || input.saveScore;
+
+			if (input.switchScoreSorting)
+			{
+				SwitchLeaderboardSorting(&leaderboard);
 			}
 
 			if (time.paused || IsGameOver(&gameData))
@@ -1580,42 +5551,107 @@ int main(int argc, char** argv)
 				SaveScore(&leaderboard, gameData.player->score, gameData.gameOverTime);
 				scoreSaved = true;
 			}
+			FlushPendingScores(&leaderboard, time.time);
 
 			if (input.pause)
 				time.paused = !time.paused;
 
 
-			SDL_UpdateTexture(scrtex, NULL, screen->pixels, screen->pitch);
-			// SDL_RenderClear(renderer);
-			SDL_RenderCopy(renderer, scrtex, NULL, NULL);
-			SDL_RenderPresent(renderer);
+			// an unchanged frame is neither copied nor presented, the window keeps showing the previous one
+			if (dirtyCount > 0)
+			{
+				{
+					ProfileScope scope(&profiler, STAGE_FRAME_COPY);
+					if (canvas.mode == RENDER_SURFACE && lockFrame)
+						SDL_UnlockTexture(scrtex);
+					else if (canvas.mode == RENDER_SURFACE)
+					{
+						int bpp = screen->format->BytesPerPixel;
+						for (int i = 0; i < dirtyCount; i++)
+						{
+							SDL_Rect* rect = &dirtyRects[i];
+							SDL_UpdateTexture(scrtex, rect, (Uint8*)screen->pixels + rect->y * screen->pitch + rect->x * bpp, screen->pitch);
+							profiler.currentCopiedBytes += rect->w * rect->h * bpp;
+						}
+					}
+				}
+				{
+					ProfileScope scope(&profiler, STAGE_PRESENT);
+					if (canvas.mode == RENDER_SURFACE)
+					{
+						// SDL_RenderClear(renderer);
+						SDL_RenderCopy(renderer, scrtex, NULL, NULL);
+					}
+					SDL_RenderPresent(renderer);
+				}
+			}
+			DrawList* drawnList = frameList;
+			frameList = previousList;
+			previousList = drawnList;
 
 			// handling of events (if there were any)
 			input.pause = false;
 			input.saveScore = false;
 			input.switchScoreSorting = false;
-			while (SDL_PollEvent(&event))
+			int eventCount = 0;
+			{
+				ProfileScope scope(&profiler, STAGE_EVENTS);
+				while (SDL_PollEvent(&event))
+				{
+					UpdateInputs(&input, event);
+					eventCount++;
+				}
+			}
+			if (input.redraw)
 			{
-				UpdateInputs(&input, event);
+				redrawAll = true;
+				input.redraw = false;
 			}
+			if (profiler.tracing)
+				TraceCounters(&profiler, gameData.npcs.count, gameData.bullets.count);
+			EndProfilerFrame(&profiler);
 
 			if (input.quit)
 				quit = 1;
 
+			// when nothing changed the next frame would be the same, so sleep until an event arrives
+			// while the simulation runs the next tick can still change it, then only sleep until that tick
+			// the leaderboard keeps scrolling while up or down is held, that needs more frames
+			if (dirtyCount == 0 && eventCount == 0 && !inputHandled && !input.up && !input.down)
+			{
+				if (SimulationSettled(&gameData, time))
+					SDL_WaitEvent(NULL);
+				else
+					SDL_WaitEventTimeout(NULL, (int)ceil((SIM_TICK_DELTA - time.accumulator) * 1000));
+			}
 			// limit the FPS
-			if (FPS_LIMIT > 0)
+			else if (fpsLimit > 0)
 			{
-				SDL_Delay(__max(1000.0 / (FPS_LIMIT) - time.delta, 0));
+				SDL_Delay(__max(1000.0 / (fpsLimit) - time.frameDelta, 0));
 			}
 			
 			time.frames++;
 		}
 
-		FreeGameMemory(&gameData);
+		if (recordPrefix != NULL)
+			SaveRecordedGame(&recording, recordPrefix, gameNumber);
 	}
 
+	FreeGameMemory(&gameData);
+	FreeDrawList(&drawLists[0]);
+	FreeDrawList(&drawLists[1]);
+	FreeReplay(&recording);
+	FreeArena(&arena);
+	FreeLeaderboard(&leaderboard);
+
+	if (traceFile != NULL)
+		WriteTrace(&profiler, traceFile);
+	FreeProfiler(&profiler);
+
 	// free all surfaces
-	FreeBitmaps(bitmaps);
+	FreeTextCache(&textCache);
+	FreeLockedFrame(&lockedFrame);
+	FreeBitmaps(&atlas, bitmaps);
 	SDL_FreeSurface(screen);
 	SDL_DestroyTexture(scrtex);
 	SDL_DestroyRenderer(renderer);